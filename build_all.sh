@@ -56,7 +56,7 @@ print_success "tutorial-01 built successfully"
 print_header "Building tutorial-02 (Character Device)"
 cd ../tutorial-02
 run_cmd "$MAKE clean && $MAKE"
-run_cmd "$GCC -o test_char test_char.c"
+run_cmd "$GCC -o test_char test_char.c -pthread"
 print_success "tutorial-02 built successfully"
 
 # Build tutorial-03
@@ -0,0 +1,122 @@
+/*
+ * User-space reader for the shared stats pages of kmem_demo, sync_demo and
+ * irq_demo, included by their test programs.
+ *
+ * Each module exports one read-only page at /proc/<module>_stats whose
+ * layout (kmem_stats.h, sync_stats.h, irq_stats.h) starts with the fields
+ * of struct stats_page_header, followed by 64-bit counters. The module
+ * makes seq odd while it updates the page, so a snapshot copies the page
+ * between two reads of seq and retries if seq was odd or changed.
+ *
+ *	const struct kmem_stats_page *page;
+ *	struct kmem_stats_page snap;
+ *
+ *	page = stats_page_map("/proc/kmem_demo_stats", KMEM_STATS_MAGIC,
+ *			      KMEM_STATS_VERSION);
+ *	stats_page_snapshot(page, &snap);
+ *	stats_page_unmap(page);
+ */
+#ifndef _STATS_READER_H
+#define _STATS_READER_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <linux/types.h>
+
+/* The fields every stats page layout starts with */
+struct stats_page_header {
+	__u32 magic;
+	__u32 version;
+	__u32 seq; /* Odd while an update is in progress */
+	__u32 reserved;
+};
+
+/* Fail the build if @type does not fit the reader */
+#define STATS_PAGE_CHECK_LAYOUT(type)                                        \
+	_Static_assert(offsetof(type, magic) ==                              \
+				       offsetof(struct stats_page_header,    \
+						magic) &&                    \
+			       offsetof(type, version) ==                    \
+				       offsetof(struct stats_page_header,    \
+						version) &&                  \
+			       offsetof(type, seq) ==                        \
+				       offsetof(struct stats_page_header,    \
+						seq) &&                      \
+			       sizeof(type) % sizeof(__u64) == 0,            \
+		       #type " is not a stats page layout")
+
+/*
+ * Map the stats page at @path and check that it has the layout the caller
+ * was built for. Returns NULL, after printing why, on failure.
+ */
+static inline const void *stats_page_map(const char *path, __u32 magic,
+					 __u32 version)
+{
+	const struct stats_page_header *hdr;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", path,
+			strerror(errno));
+		return NULL;
+	}
+	hdr = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		fprintf(stderr, "Failed to map %s: %s\n", path,
+			strerror(errno));
+		return NULL;
+	}
+	if (hdr->magic != magic || hdr->version != version) {
+		fprintf(stderr, "Unexpected layout of %s\n", path);
+		munmap((void *)hdr, sysconf(_SC_PAGESIZE));
+		return NULL;
+	}
+	return hdr;
+}
+
+static inline void stats_page_unmap(const void *page)
+{
+	munmap((void *)page, sysconf(_SC_PAGESIZE));
+}
+
+/*
+ * Copy the first @size bytes of @page into @out without a system call.
+ * Returns how many times the copy had to be retried because the module
+ * was publishing.
+ */
+static inline unsigned int stats_page_read(const void *page, void *out,
+					   size_t size)
+{
+	const struct stats_page_header *hdr = page;
+	const __u64 *src = page;
+	__u64 *dst = out;
+	unsigned int retries = 0;
+	__u32 seq;
+	size_t i;
+
+	for (;;) {
+		seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1)) {
+			for (i = 0; i < size / sizeof(*src); i++)
+				dst[i] = __atomic_load_n(&src[i],
+							 __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == seq)
+				return retries;
+		}
+		retries++;
+	}
+}
+
+/* Snapshot a mapped page into @out, a pointer to its layout struct */
+#define stats_page_snapshot(page, out) \
+	stats_page_read(page, out, sizeof(*(out)))
+
+#endif /* _STATS_READER_H */
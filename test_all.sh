@@ -133,7 +133,7 @@ run_cmd "$MAKE clean && $MAKE"
 print_success "Tutorial-02 built successfully"
 
 # Build the test program
-run_cmd "$GCC -o test_char test_char.c"
+run_cmd "$GCC -o test_char test_char.c -pthread"
 print_success "Built test_char program"
 
 # Load the module
@@ -141,19 +141,19 @@ run_cmd "insmod simple_char.ko"
 print_success "Loaded simple_char.ko module"
 
 # Check that the device was created
-if [ -c /dev/simple_char ]; then
-    print_success "Device /dev/simple_char was created"
+if [ -c /dev/simple_char0 ]; then
+    print_success "Device /dev/simple_char0 was created"
 else
-    print_error "Device /dev/simple_char was not created"
+    print_error "Device /dev/simple_char0 was not created"
 fi
 
 # Run basic tests on the device
 echo "Testing write to device..."
-echo "Test data" > /dev/simple_char
+echo "Test data" > /dev/simple_char0
 print_success "Wrote data to device"
 
 echo "Testing read from device..."
-READ_DATA=$(cat /dev/simple_char)
+READ_DATA=$(cat /dev/simple_char0)
 if [[ "$READ_DATA" == *"Test data"* ]]; then
     print_success "Read correct data from device"
 else
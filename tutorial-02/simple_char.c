@@ -1,15 +1,69 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/init.h>
-#include <linux/fs.h> /* For register_chrdev, file_operations */
+#include <linux/fs.h> /* For alloc_chrdev_region, file_operations */
 #include <linux/uaccess.h> /* For copy_to_user, copy_from_user */
 #include <linux/device.h> /* For device_create, class_create */
 #include <linux/cdev.h> /* For cdev_init, cdev_add */
+#include <linux/mm.h> /* For vm_area_struct, vm_fault */
+#include <linux/highmem.h> /* For kmap_local_page */
+#include <linux/xarray.h> /* For the sparse page store */
+#include <linux/rwsem.h> /* For the per-page read/write locks */
+#include <linux/hash.h> /* For hash_long */
+#include <linux/vmalloc.h> /* For vmalloc, vfree */
+#include <linux/wait.h> /* For wait queues */
+#include <linux/poll.h> /* For poll_wait, EPOLLIN */
+#include <linux/log2.h> /* For is_power_of_2 */
+#include <linux/uio.h> /* For iov_iter */
+#include <linux/splice.h> /* For splice_read, add_to_pipe */
+#include <linux/pipe_fs_i.h> /* For pipe_buffer */
+#include <linux/percpu.h> /* For per-CPU statistics */
+#include <linux/u64_stats_sync.h> /* For u64_stats_t */
+#include <linux/slab.h> /* For kzalloc_node */
+#include <linux/nodemask.h> /* For node_online, next_online_node */
+#include <linux/huge_mm.h> /* For vmf_insert_pfn_pmd */
+#include <linux/timekeeping.h> /* For ktime_get_ns */
+#include <linux/smp.h> /* For smp_call_on_cpu */
+#include <linux/cpu.h> /* For cpus_read_lock */
+#include <linux/refcount.h> /* For refcount_t */
+#include <linux/overflow.h> /* For struct_size */
+#include <linux/capability.h> /* For capable */
+#include <linux/rcupdate.h> /* For RCU-published snapshot versions */
+#include <linux/kref.h> /* For pinning versions */
+#include <linux/mutex.h> /* For the snapshot writer lock */
+#include <linux/eventfd.h> /* For eventfd_signal */
+#include <linux/hrtimer.h> /* For notification coalescing */
+#include <linux/rculist.h> /* For the notifier list */
+#include <linux/bvec.h> /* For bio_vec over pinned user pages */
+#include <linux/workqueue.h> /* For the parallel direct copy */
+#include <linux/lz4.h> /* For the compressed store */
 #include <linux/version.h> /* For LINUX_VERSION_CODE */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+#include <linux/io_uring/cmd.h> /* For io_uring_cmd */
+#else
+#include <linux/io_uring.h> /* For io_uring_cmd */
+#endif
+
+#include "simple_char.h"
+
+/* Generate the tracepoint definitions in this file */
+#define CREATE_TRACE_POINTS
+#include "simple_char_trace.h"
 
 #define DEVICE_NAME "simple_char"
 #define CLASS_NAME "simple"
-#define BUFFER_SIZE 1024
+#define MAX_DEVICES 64
+
+/* Direct transfers at least this large are split across CPUs */
+#define DIRECT_SPLIT_MIN (4 << 20)
+/* Smallest piece handed to one worker */
+#define DIRECT_PIECE_MIN (1 << 20)
+
+/* Iterator directions were named READ and WRITE before Linux 6.1 */
+#ifndef ITER_DEST
+#define ITER_DEST READ
+#define ITER_SOURCE WRITE
+#endif
 
 /* Module metadata */
 MODULE_LICENSE("GPL");
@@ -17,202 +71,3117 @@ MODULE_AUTHOR("Utsav Balar");
 MODULE_DESCRIPTION("A simple character device driver example");
 MODULE_VERSION("0.1");
 
-/* Global variables for our device */
-static int major_number; /* Will store our device's major number */
-static char device_buffer[BUFFER_SIZE]; /* Memory buffer for the device */
+/* Largest logical size the device may grow to */
+static unsigned long max_size_mb = 4096;
+module_param(max_size_mb, ulong, 0444);
+MODULE_PARM_DESC(max_size_mb, "Maximum device size in MB (default: 4096)");
+
+#define MAX_DEVICE_SIZE ((loff_t)max_size_mb << 20)
+#define MAX_DEVICE_PAGES (MAX_DEVICE_SIZE >> PAGE_SHIFT)
+
+/* Device mode: a random-access buffer, a blocking FIFO or an append log */
+static char *mode = "buffer";
+module_param(mode, charp, 0444);
+MODULE_PARM_DESC(mode,
+		 "Device mode: buffer (default), fifo, log, snapshot or compressed");
+
+/* Ring size used in FIFO mode */
+static unsigned int fifo_size = 64 * 1024;
+module_param(fifo_size, uint, 0444);
+MODULE_PARM_DESC(fifo_size,
+		 "FIFO ring size in bytes, a power of two (default: 65536)");
+
+/* Shard size used in log mode */
+static unsigned int log_size = 4 << 20;
+module_param(log_size, uint, 0444);
+MODULE_PARM_DESC(log_size, "Per-CPU log shard size in bytes (default: 4194304)");
+
+/* Uncompressed pages cached per device in compressed mode */
+static unsigned int hot_pages = 64;
+module_param(hot_pages, uint, 0444);
+MODULE_PARM_DESC(hot_pages,
+		 "Uncompressed pages cached per device in compressed mode (default: 64)");
+
+/* Size of the region preallocated with PMD-sized pages */
+static unsigned long huge_size_mb;
+module_param(huge_size_mb, ulong, 0444);
+MODULE_PARM_DESC(huge_size_mb,
+		 "Preallocate this many MB per device as 2 MB pages, mapped with huge PMDs (default: 0)");
+
+/* Number of independent device instances */
+static unsigned int num_devices = 1;
+module_param(num_devices, uint, 0444);
+MODULE_PARM_DESC(num_devices, "Number of devices, /dev/simple_char0..N-1 (default: 1)");
+
+/* NUMA node for each instance's memory */
+static int nodes[MAX_DEVICES];
+static int nr_nodes;
+module_param_array(nodes, int, &nr_nodes, 0444);
+MODULE_PARM_DESC(nodes,
+		 "NUMA node per device, e.g. nodes=0,1 (default: round-robin over online nodes)");
+
+/* Number of page lock stripes, as a power of two */
+#define PAGE_LOCK_BITS 6
+
+/*
+ * FIFO mode ring buffer
+ *
+ * A single-producer/single-consumer ring: only the producer advances
+ * head and only the consumer advances tail, so the two sides never share
+ * a lock. head and tail are free-running and masked on access. Multiple
+ * readers (or writers) are serialized among themselves by read_lock (or
+ * write_lock), which keeps the ring itself single-producer/single-consumer.
+ */
+struct simple_fifo {
+	char *data;
+	unsigned int size; /* Power of two */
+	unsigned int head ____cacheline_aligned_in_smp; /* Producer index */
+	unsigned int tail ____cacheline_aligned_in_smp; /* Consumer index */
+	struct mutex read_lock;
+	struct mutex write_lock;
+	wait_queue_head_t read_wq; /* Readers waiting for data */
+	wait_queue_head_t write_wq; /* Writers waiting for space */
+};
+
+/*
+ * Log mode shard. Each CPU appends records to its own shard, so writers
+ * share no locks, atomics or cache lines. Only the owning CPU writes
+ * head, with preemption disabled, and publishes it with a release store
+ * after the record is complete; readers acquire it and never look past it.
+ */
+struct simple_log_shard {
+	char *data;
+	unsigned int head; /* Bytes of complete records */
+};
+
+/*
+ * Snapshot mode page table chunk: the pages of one 2 MB range. A chunk is
+ * shared, by reference count, between every version that has not written
+ * to that range since, and is never modified once a version using it is
+ * published.
+ */
+#define SNAP_CHUNK_SHIFT 9
+#define SNAP_CHUNK_PAGES (1UL << SNAP_CHUNK_SHIFT)
+
+struct simple_snap_chunk {
+	refcount_t ref; /* One per version using the chunk */
+	struct page *pages[SNAP_CHUNK_PAGES]; /* NULL for holes */
+};
+
+/*
+ * Snapshot mode buffer version. A version is never modified once it is
+ * published: writers copy the chunk array, replace only the chunks they
+ * touch (untouched chunks are shared) and publish the result with RCU.
+ * Readers pin a version with its kref and copy from it without any lock.
+ * The last reference frees the version after an RCU grace period, since a
+ * reader may still be looking at it under rcu_read_lock().
+ */
+struct simple_version {
+	struct kref ref;
+	struct rcu_head rcu;
+	loff_t size; /* Logical size of this version */
+	unsigned long nr_chunks; /* Entries in chunks[] */
+	struct simple_snap_chunk *chunks[]; /* NULL for holes */
+};
+
+/*
+ * Compressed mode store. Cold pages are kept LZ4-compressed in cold; the
+ * pages being accessed are decompressed into a small LRU cache of at most
+ * hot_pages uncompressed pages. A clean hot page keeps its compressed copy,
+ * so evicting it is free; a dirty one is compressed again on eviction.
+ * Everything is serialized by lock, which also protects the counters.
+ */
+struct simple_comp {
+	struct mutex lock;
+	struct xarray cold; /* Page index -> struct simple_comp_page */
+	struct xarray hot; /* Page index -> struct simple_hot_page */
+	struct list_head lru; /* Hot pages, most recently used first */
+	unsigned int nr_hot;
+	void *wrkmem; /* LZ4 compression state */
+	void *scratch; /* Compression output, LZ4_COMPRESSBOUND(PAGE_SIZE) */
+	u64 cold_pages; /* Entries in cold */
+	u64 cold_bytes; /* Compressed bytes held in cold */
+	u64 hits; /* Accesses served by the hot cache */
+	u64 misses; /* Accesses that needed a decompression */
+	u64 decompress_ns; /* Total time spent decompressing */
+	u64 evict_failures; /* Dirty victims that could not be compressed */
+};
+
+/* One compressed page; len == PAGE_SIZE means stored uncompressed */
+struct simple_comp_page {
+	unsigned int len;
+	u8 data[];
+};
+
+/* One uncompressed page in the hot cache */
+struct simple_hot_page {
+	struct list_head lru;
+	pgoff_t index;
+	struct page *page;
+	bool dirty; /* Newer than the compressed copy, if any */
+};
+
+/*
+ * An eventfd registered with SIMPLE_CHAR_IOC_SET_EVENTFD, signalled on
+ * writes to the device. With coalescing, the first write in a quiet
+ * period signals at once and arms the timer; writes while it is armed
+ * only set PENDING, and the timer sends one more signal for all of them.
+ */
+struct simple_notifier {
+	struct list_head node; /* On simple_dev.notifiers, RCU protected */
+	struct file *owner; /* File that registered it */
+	struct eventfd_ctx *ctx;
+	ktime_t interval; /* Zero: signal every write */
+	struct hrtimer timer;
+	unsigned long flags;
+#define NOTIFY_ARMED 0 /* Inside a coalescing interval */
+#define NOTIFY_PENDING 1 /* A write arrived during the interval */
+};
+
+/*
+ * Per-CPU I/O statistics. The hot path only touches the local CPU's
+ * counters; readers of the sysfs attributes sum over all CPUs.
+ */
+struct simple_stats {
+	u64_stats_t read_ops;
+	u64_stats_t read_bytes;
+	u64_stats_t write_ops;
+	u64_stats_t write_bytes;
+	struct u64_stats_sync syncp;
+};
+
+/*
+ * One device instance, /dev/simple_charN. Each instance is allocated on
+ * its own NUMA node together with its pages and FIFO ring, so workloads
+ * pinned to different nodes never share cache lines or memory.
+ *
+ * Concurrency model
+ *
+ * Every page of the store is covered by one of a set of striped
+ * read/write semaphores. Readers take the stripe shared, so any number
+ * of readers run in parallel; writers take it exclusive, so writers only
+ * serialize against accesses to pages that hash to the same stripe.
+ *
+ * Consistency guarantee: each page-sized piece of a read() or write() is
+ * atomic with respect to other reads and writes, so a reader never sees a
+ * half-applied write within one page. A request that spans several pages
+ * is applied one page at a time, so a concurrent reader may see a
+ * multi-page write partly applied. Stores through mmap() bypass the locks
+ * and have no such guarantee.
+ */
+struct simple_dev {
+	struct cdev cdev; /* Character device structure */
+	struct device *device; /* Device in /sys/class/simple */
+	int node; /* NUMA node holding this device's memory */
+	struct xarray pages; /* Sparse store: page index -> page */
+	atomic64_t size; /* Logical size, highest byte ever written */
+	atomic_long_t nr_pages; /* Pages in use */
+	unsigned long nr_huge; /* PMD-sized pages preallocated */
+	struct rw_semaphore page_locks[1 << PAGE_LOCK_BITS];
+	struct simple_fifo fifo; /* Ring buffer, FIFO mode only */
+	struct simple_log_shard __percpu *log; /* Shards, log mode only */
+	unsigned int log_gen; /* Bumped when the log is reset */
+	struct simple_version __rcu *version; /* Snapshot mode only */
+	struct mutex version_lock; /* Serializes snapshot writers */
+	struct simple_comp comp; /* Compressed mode only */
+	struct fasync_struct *fasync; /* SIGIO subscribers */
+	struct list_head notifiers; /* eventfd notifiers */
+	struct mutex notify_lock; /* Serializes notifier list updates */
+	struct simple_stats __percpu *stats;
+};
+
+/* Global variables for the driver */
+static dev_t simple_devt; /* First device number of our region */
 static struct class *simple_class = NULL; /* Device class */
-static struct device *simple_device = NULL; /* Device */
-static struct cdev simple_cdev; /* Character device structure */
+static struct simple_dev *simple_devs[MAX_DEVICES]; /* Device instances */
 
 /* Prototypes for device functions */
 static int char_open(struct inode *, struct file *);
 static int char_release(struct inode *, struct file *);
-static ssize_t char_read(struct file *, char __user *, size_t, loff_t *);
-static ssize_t char_write(struct file *, const char __user *, size_t, loff_t *);
+static ssize_t char_read_iter(struct kiocb *, struct iov_iter *);
+static ssize_t char_write_iter(struct kiocb *, struct iov_iter *);
+static ssize_t char_splice_read(struct file *, loff_t *,
+				struct pipe_inode_info *, size_t, unsigned int);
 static loff_t char_llseek(struct file *, loff_t, int);
+static int char_mmap(struct file *, struct vm_area_struct *);
+static long char_ioctl(struct file *, unsigned int, unsigned long);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+static int char_uring_cmd(struct io_uring_cmd *, unsigned int);
+#endif
+static int fifo_open(struct inode *, struct file *);
+static ssize_t fifo_read_iter(struct kiocb *, struct iov_iter *);
+static ssize_t fifo_write_iter(struct kiocb *, struct iov_iter *);
+static __poll_t fifo_poll(struct file *, poll_table *);
+static int log_open(struct inode *, struct file *);
+static int log_release(struct inode *, struct file *);
+static ssize_t log_read_iter(struct kiocb *, struct iov_iter *);
+static ssize_t log_write_iter(struct kiocb *, struct iov_iter *);
+static int log_mmap(struct file *, struct vm_area_struct *);
+static long log_ioctl(struct file *, unsigned int, unsigned long);
+static int snap_open(struct inode *, struct file *);
+static int snap_release(struct inode *, struct file *);
+static ssize_t snap_read_iter(struct kiocb *, struct iov_iter *);
+static ssize_t snap_write_iter(struct kiocb *, struct iov_iter *);
+static loff_t snap_llseek(struct file *, loff_t, int);
+static ssize_t comp_read_iter(struct kiocb *, struct iov_iter *);
+static ssize_t comp_write_iter(struct kiocb *, struct iov_iter *);
+static int simple_fasync(int, struct file *, int);
+static long notify_ioctl(struct file *, unsigned int, unsigned long);
 
 /* Define file operations for our device */
 static struct file_operations simple_fops = {
 	.owner = THIS_MODULE,
 	.open = char_open,
 	.release = char_release,
-	.read = char_read,
-	.write = char_write,
+	.read_iter = char_read_iter,
+	.write_iter = char_write_iter,
+	.splice_read = char_splice_read,
+	.splice_write = iter_file_splice_write,
+	.llseek = char_llseek,
+	.mmap = char_mmap,
+	/* Place mappings on 2 MB boundaries so huge PMDs can be used */
+	.get_unmapped_area = thp_get_unmapped_area,
+	.unlocked_ioctl = char_ioctl,
+	/* The batch layout is the same for 32-bit callers */
+	.compat_ioctl = compat_ptr_ioctl,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+	.uring_cmd = char_uring_cmd,
+#endif
+	.fasync = simple_fasync,
+};
+
+/* File operations used in FIFO mode */
+static struct file_operations simple_fifo_fops = {
+	.owner = THIS_MODULE,
+	.open = fifo_open,
+	.release = char_release,
+	.read_iter = fifo_read_iter,
+	.write_iter = fifo_write_iter,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+	.splice_read = copy_splice_read,
+#else
+	.splice_read = generic_file_splice_read,
+#endif
+	.splice_write = iter_file_splice_write,
+	.poll = fifo_poll,
+	.unlocked_ioctl = notify_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.fasync = simple_fasync,
+};
+
+/* File operations used in log mode */
+static struct file_operations simple_log_fops = {
+	.owner = THIS_MODULE,
+	.open = log_open,
+	.release = log_release,
+	.read_iter = log_read_iter,
+	.write_iter = log_write_iter,
+	.mmap = log_mmap,
+	.unlocked_ioctl = log_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.fasync = simple_fasync,
+};
+
+/* File operations used in snapshot mode */
+static struct file_operations simple_snap_fops = {
+	.owner = THIS_MODULE,
+	.open = snap_open,
+	.release = snap_release,
+	.read_iter = snap_read_iter,
+	.write_iter = snap_write_iter,
+	.llseek = snap_llseek,
+	.unlocked_ioctl = notify_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.fasync = simple_fasync,
+};
+
+/* File operations used in compressed mode; the store cannot be mapped */
+static struct file_operations simple_comp_fops = {
+	.owner = THIS_MODULE,
+	.open = char_open,
+	.release = char_release,
+	.read_iter = comp_read_iter,
+	.write_iter = comp_write_iter,
 	.llseek = char_llseek,
+	.unlocked_ioctl = notify_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.fasync = simple_fasync,
 };
 
+/*
+ * Look up the page backing @index, allocating a zeroed page on first use.
+ * Pages are only ever added to the store, never replaced, so a lookup that
+ * finds a page can use it without further checks. @gfp is GFP_KERNEL, or
+ * GFP_NOWAIT for callers that must not sleep.
+ */
+static struct page *simple_get_page(struct simple_dev *dev, pgoff_t index,
+				    gfp_t gfp)
+{
+	struct page *page, *old;
+
+	page = xa_load(&dev->pages, index);
+	if (page)
+		return page;
+
+	/* Allocate on the device's node, wherever the writer runs */
+	page = alloc_pages_node(dev->node, gfp | __GFP_HIGHMEM | __GFP_ZERO, 0);
+	if (!page)
+		return NULL;
+
+	/* Someone else may have populated the slot while we allocated */
+	old = xa_cmpxchg(&dev->pages, index, NULL, page, gfp);
+	if (old) {
+		__free_page(page);
+		return xa_is_err(old) ? NULL : old;
+	}
+
+	atomic_long_inc(&dev->nr_pages);
+	return page;
+}
+
+/* Return the lock stripe covering page @index */
+static struct rw_semaphore *simple_page_lock(struct simple_dev *dev,
+					     pgoff_t index)
+{
+	return &dev->page_locks[hash_long(index, PAGE_LOCK_BITS)];
+}
+
+/* Raise the logical size to @end unless it is already larger */
+static void simple_grow_size(struct simple_dev *dev, loff_t end)
+{
+	s64 size = atomic64_read(&dev->size);
+
+	while (end > size) {
+		if (atomic64_try_cmpxchg(&dev->size, &size, end))
+			break;
+	}
+}
+
+/* Count one read or write of @bytes on the local CPU */
+static void simple_account(struct simple_dev *dev, bool write, size_t bytes)
+{
+	struct simple_stats *stats = get_cpu_ptr(dev->stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	if (write) {
+		u64_stats_inc(&stats->write_ops);
+		u64_stats_add(&stats->write_bytes, bytes);
+	} else {
+		u64_stats_inc(&stats->read_ops);
+		u64_stats_add(&stats->read_bytes, bytes);
+	}
+	u64_stats_update_end(&stats->syncp);
+	put_cpu_ptr(dev->stats);
+}
+
+/*
+ * The device behind @file. Most modes keep it in private_data, but log
+ * mode keeps a reader cursor there, so go through the embedded cdev.
+ */
+static struct simple_dev *simple_file_dev(struct file *file)
+{
+	return container_of(file_inode(file)->i_cdev, struct simple_dev, cdev);
+}
+
+/* Signal one eventfd */
+static void simple_eventfd_signal(struct eventfd_ctx *ctx)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	eventfd_signal(ctx);
+#else
+	eventfd_signal(ctx, 1);
+#endif
+}
+
+/*
+ * End of a coalescing interval. If writes arrived during it, signal once
+ * for all of them and start another interval; otherwise disarm. ARMED is
+ * cleared before PENDING is checked again, so a write racing with the
+ * expiry either sees ARMED clear and signals itself, or is picked up here.
+ */
+static enum hrtimer_restart simple_notify_timer(struct hrtimer *timer)
+{
+	struct simple_notifier *n =
+		container_of(timer, struct simple_notifier, timer);
+
+	if (!test_and_clear_bit(NOTIFY_PENDING, &n->flags)) {
+		clear_bit(NOTIFY_ARMED, &n->flags);
+		smp_mb__after_atomic();
+		if (!test_bit(NOTIFY_PENDING, &n->flags) ||
+		    test_and_set_bit(NOTIFY_ARMED, &n->flags))
+			return HRTIMER_NORESTART;
+		clear_bit(NOTIFY_PENDING, &n->flags);
+	}
+
+	simple_eventfd_signal(n->ctx);
+	hrtimer_forward_now(timer, n->interval);
+	return HRTIMER_RESTART;
+}
+
+/* Tell SIGIO and eventfd subscribers that the device changed */
+static void simple_notify(struct simple_dev *dev)
+{
+	struct simple_notifier *n;
+
+	kill_fasync(&dev->fasync, SIGIO, POLL_IN);
+
+	/* Writers never take a lock here; the list is read under RCU */
+	if (list_empty(&dev->notifiers))
+		return;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(n, &dev->notifiers, node) {
+		if (!n->interval) {
+			simple_eventfd_signal(n->ctx);
+		} else if (!test_and_set_bit(NOTIFY_ARMED, &n->flags)) {
+			simple_eventfd_signal(n->ctx);
+			hrtimer_start(&n->timer, n->interval,
+				      HRTIMER_MODE_REL_SOFT);
+		} else {
+			set_bit(NOTIFY_PENDING, &n->flags);
+		}
+	}
+	rcu_read_unlock();
+}
+
+/* Unlink @n and free it once no writer can be signalling it */
+static void simple_notifier_free(struct simple_notifier *n)
+{
+	list_del_rcu(&n->node);
+	synchronize_rcu();
+	hrtimer_cancel(&n->timer);
+	eventfd_ctx_put(n->ctx);
+	kfree(n);
+}
+
+/* Remove the eventfd registered through @file, if any */
+static void simple_notify_remove(struct simple_dev *dev, struct file *file)
+{
+	struct simple_notifier *n, *tmp;
+
+	mutex_lock(&dev->notify_lock);
+	list_for_each_entry_safe(n, tmp, &dev->notifiers, node) {
+		if (n->owner == file)
+			simple_notifier_free(n);
+	}
+	mutex_unlock(&dev->notify_lock);
+}
+
+/*
+ * Register (or with fd < 0, remove) the eventfd of @file. Each file has
+ * at most one; registering again replaces it.
+ */
+static int simple_notify_set(struct file *file,
+			     const struct simple_char_eventfd *req)
+{
+	struct simple_dev *dev = simple_file_dev(file);
+	struct simple_notifier *n;
+	struct eventfd_ctx *ctx;
+
+	simple_notify_remove(dev, file);
+	if (req->fd < 0)
+		return 0;
+
+	ctx = eventfd_ctx_fdget(req->fd);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+
+	n = kzalloc(sizeof(*n), GFP_KERNEL);
+	if (!n) {
+		eventfd_ctx_put(ctx);
+		return -ENOMEM;
+	}
+	n->owner = file;
+	n->ctx = ctx;
+	n->interval = us_to_ktime(req->coalesce_us);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&n->timer, simple_notify_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL_SOFT);
+#else
+	hrtimer_init(&n->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	n->timer.function = simple_notify_timer;
+#endif
+
+	mutex_lock(&dev->notify_lock);
+	list_add_tail_rcu(&n->node, &dev->notifiers);
+	mutex_unlock(&dev->notify_lock);
+	return 0;
+}
+
+/* Called by fcntl(F_SETFL, O_ASYNC) to subscribe to SIGIO */
+static int simple_fasync(int fd, struct file *file, int on)
+{
+	return fasync_helper(fd, file, on, &simple_file_dev(file)->fasync);
+}
+
+/* Drop the SIGIO and eventfd subscriptions of a file being closed */
+static void simple_notify_release(struct file *file)
+{
+	simple_fasync(-1, file, 0);
+	simple_notify_remove(simple_file_dev(file), file);
+}
+
+/* ioctl commands available in every mode */
+static long notify_ioctl(struct file *file, unsigned int cmd,
+			 unsigned long arg)
+{
+	struct simple_char_eventfd req;
+
+	switch (cmd) {
+	case SIMPLE_CHAR_IOC_SET_EVENTFD:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+		return simple_notify_set(file, &req);
+	default:
+		return -ENOTTY;
+	}
+}
+
+/* Trace a completed read or write and count it if it moved data */
+static void simple_io_done(struct file *file, bool write, loff_t pos,
+			   size_t count, ssize_t ret)
+{
+	unsigned int minor = iminor(file_inode(file));
+
+	if (write)
+		trace_simple_char_write(minor, pos, count, ret);
+	else
+		trace_simple_char_read(minor, pos, count, ret);
+
+	if (ret > 0) {
+		simple_account(simple_file_dev(file), write, ret);
+		if (write)
+			simple_notify(simple_file_dev(file));
+	}
+}
+
+/* Release every page in the store */
+static void simple_free_pages(struct simple_dev *dev)
+{
+	struct page *page;
+	unsigned long index;
+
+	xa_for_each(&dev->pages, index, page) {
+		/* A huge page is freed as a whole through its head page */
+		if (PageTail(page))
+			continue;
+		__free_pages(page, compound_order(page));
+	}
+	xa_destroy(&dev->pages);
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Fill the first huge_size_mb of the store with PMD-sized pages, whose
+ * subpages are stored in the xarray like any other page. If a high-order
+ * allocation fails, that 2 MB range gets order-0 pages instead and is
+ * mapped with ordinary PTEs. The populated region counts as written, so
+ * read(), splice and SEEK_END see the same bytes that mmap() serves.
+ */
+static int simple_huge_populate(struct simple_dev *dev)
+{
+	pgoff_t nr = round_up((huge_size_mb << 20) >> PAGE_SHIFT, HPAGE_PMD_NR);
+	pgoff_t index;
+	int i;
+
+	for (index = 0; index < nr; index += HPAGE_PMD_NR) {
+		struct page *huge;
+
+		huge = alloc_pages_node(dev->node,
+					GFP_HIGHUSER | __GFP_ZERO | __GFP_COMP |
+						__GFP_NOWARN | __GFP_NORETRY,
+					HPAGE_PMD_ORDER);
+		if (huge)
+			dev->nr_huge++;
+
+		for (i = 0; i < HPAGE_PMD_NR; i++) {
+			struct page *page = huge ? huge + i :
+				alloc_pages_node(dev->node,
+						 GFP_HIGHUSER | __GFP_ZERO, 0);
+
+			if (!page)
+				return -ENOMEM;
+			if (xa_err(xa_store(&dev->pages, index + i, page,
+					    GFP_KERNEL))) {
+				/* Tails of a stored head are freed with it */
+				if (!huge)
+					__free_page(page);
+				else if (!i)
+					__free_pages(huge, HPAGE_PMD_ORDER);
+				return -ENOMEM;
+			}
+			atomic_long_inc(&dev->nr_pages);
+		}
+	}
+
+	simple_grow_size(dev, (loff_t)nr << PAGE_SHIFT);
+	return 0;
+}
+
+/*
+ * Map a whole 2 MB page with one PMD. Returning VM_FAULT_FALLBACK makes
+ * the core retry with char_pfn_fault for just the faulting 4 KB page, so
+ * ranges that fell back to order-0 pages, or mappings whose offset is not
+ * 2 MB aligned, still work.
+ */
+static vm_fault_t simple_huge_fault_pmd(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct simple_dev *dev = vma->vm_file->private_data;
+	unsigned long haddr = vmf->address & HPAGE_PMD_MASK;
+	pgoff_t index = linear_page_index(vma, haddr);
+	struct page *page;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end ||
+	    !IS_ALIGNED(index, HPAGE_PMD_NR))
+		return VM_FAULT_FALLBACK;
+
+	page = xa_load(&dev->pages, index);
+	if (!page || !PageHead(page) ||
+	    compound_order(page) != HPAGE_PMD_ORDER)
+		return VM_FAULT_FALLBACK;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0)
+	return vmf_insert_pfn_pmd(vmf, page_to_pfn(page),
+				  vmf->flags & FAULT_FLAG_WRITE);
+#else
+	return vmf_insert_pfn_pmd(vmf, pfn_to_pfn_t(page_to_pfn(page)),
+				  vmf->flags & FAULT_FLAG_WRITE);
+#endif
+}
+
+/* Called for faults the core could map with a page table entry above 4 KB */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+static vm_fault_t char_huge_fault(struct vm_fault *vmf, unsigned int order)
+{
+	if (order != HPAGE_PMD_ORDER)
+		return VM_FAULT_FALLBACK;
+	return simple_huge_fault_pmd(vmf);
+}
+#else
+static vm_fault_t char_huge_fault(struct vm_fault *vmf,
+				  enum page_entry_size pe_size)
+{
+	if (pe_size != PE_SIZE_PMD)
+		return VM_FAULT_FALLBACK;
+	return simple_huge_fault_pmd(vmf);
+}
+#endif
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /* Called when device is opened */
 static int char_open(struct inode *inode, struct file *file)
 {
-	/* Nothing special to do here */
-	printk(KERN_INFO "SIMPLE: Device opened\n");
+	/* Find our instance from the cdev embedded in it */
+	file->private_data =
+		container_of(inode->i_cdev, struct simple_dev, cdev);
+
+	/*
+	 * Have the VFS serialize f_pos updates, so threads sharing one file
+	 * descriptor do not race on the file position in char_read_iter and
+	 * char_write_iter.
+	 */
+	file->f_mode |= FMODE_ATOMIC_POS;
+
+	/* Reads and writes honour IOCB_NOWAIT, so io_uring can issue inline */
+	file->f_mode |= FMODE_NOWAIT;
+
+	trace_simple_char_open(iminor(inode), file->f_flags);
 	return 0;
 }
 
 /* Called when device is closed */
 static int char_release(struct inode *inode, struct file *file)
 {
-	printk(KERN_INFO "SIMPLE: Device closed\n");
+	simple_notify_release(file);
+	trace_simple_char_release(iminor(inode));
 	return 0;
 }
 
-/* Called when user reads from the device */
-static ssize_t char_read(struct file *file, char __user *user_buffer,
-			 size_t count, loff_t *offset)
+/*
+ * Copy from the store at @pos into @to, stopping at the logical end of the
+ * device. With @nowait set the page locks are only tried, and -EAGAIN is
+ * returned if nothing could be copied without sleeping. Returns the number
+ * of bytes copied or a negative errno.
+ */
+static ssize_t simple_read(struct simple_dev *dev, loff_t pos,
+			   struct iov_iter *to, bool nowait)
 {
-	int bytes_to_read;
-	int bytes_not_copied;
+	loff_t size = atomic64_read(&dev->size);
+	size_t count = iov_iter_count(to);
+	size_t bytes_read = 0;
 
-	/* Calculate bytes to read */
-	bytes_to_read = min((size_t)(BUFFER_SIZE - *offset), count);
+	/* Reads stop at the logical end of the device */
+	count = pos < size ? min_t(loff_t, count, size - pos) : 0;
 
-	if (bytes_to_read <= 0)
-		return 0; /* EOF */
+	/* Copy page by page, since the pages are not contiguous */
+	while (bytes_read < count) {
+		loff_t cur = pos + bytes_read;
+		size_t page_offset = offset_in_page(cur);
+		size_t chunk = min_t(size_t, PAGE_SIZE - page_offset,
+				     count - bytes_read);
+		pgoff_t index = cur >> PAGE_SHIFT;
+		struct rw_semaphore *lock = simple_page_lock(dev, index);
+		struct page *page;
+		size_t copied;
 
-	/* Copy data to user space */
-	bytes_not_copied = copy_to_user(user_buffer, device_buffer + *offset,
-					bytes_to_read);
-
-	/* Update file position */
-	*offset += (bytes_to_read - bytes_not_copied);
+		/* Shared lock: readers of the same page do not block */
+		if (!nowait)
+			down_read(lock);
+		else if (!down_read_trylock(lock))
+			return bytes_read ? bytes_read : -EAGAIN;
+		page = xa_load(&dev->pages, index);
+		if (page)
+			copied = copy_page_to_iter(page, page_offset, chunk, to);
+		else
+			/* Holes read back as zeros without allocating a page */
+			copied = iov_iter_zero(chunk, to);
+		up_read(lock);
 
-	printk(KERN_INFO "SIMPLE: Read %d bytes\n",
-	       bytes_to_read - bytes_not_copied);
+		bytes_read += copied;
+		if (copied < chunk)
+			break;
+	}
 
-	/* Return number of bytes successfully read */
-	return (bytes_to_read - bytes_not_copied);
+	/* Return number of bytes successfully read, 0 at EOF */
+	return (!bytes_read && count) ? -EFAULT : bytes_read;
 }
 
-/* Called when user writes to the device */
-static ssize_t char_write(struct file *file, const char __user *user_buffer,
-			  size_t count, loff_t *offset)
+/*
+ * Copy @from into the store at @pos, allocating pages the first time they
+ * are written and growing the logical size. @nowait works as for
+ * simple_read(), and also keeps page allocation from sleeping. Returns the
+ * number of bytes copied or a negative errno.
+ */
+static ssize_t simple_write(struct simple_dev *dev, loff_t pos,
+			    struct iov_iter *from, bool nowait)
 {
-	int bytes_to_write;
-	int bytes_not_copied;
-
-	/* Calculate bytes to write */
-	bytes_to_write = min((size_t)(BUFFER_SIZE - *offset), count);
+	size_t count = iov_iter_count(from);
+	size_t bytes_written = 0;
+	ssize_t err = -EFAULT;
 
-	if (bytes_to_write <= 0)
+	if (pos >= MAX_DEVICE_SIZE)
 		return -ENOSPC; /* No space left on device */
+	count = min_t(loff_t, count, MAX_DEVICE_SIZE - pos);
 
-	/* Copy data from user space */
-	bytes_not_copied = copy_from_user(device_buffer + *offset, user_buffer,
-					  bytes_to_write);
+	while (bytes_written < count) {
+		loff_t cur = pos + bytes_written;
+		size_t page_offset = offset_in_page(cur);
+		size_t chunk = min_t(size_t, PAGE_SIZE - page_offset,
+				     count - bytes_written);
+		pgoff_t index = cur >> PAGE_SHIFT;
+		struct rw_semaphore *lock = simple_page_lock(dev, index);
+		struct page *page;
+		size_t copied;
 
-	/* Update file position */
-	*offset += (bytes_to_write - bytes_not_copied);
+		/* Exclusive lock: only writers to this stripe serialize */
+		if (!nowait) {
+			down_write(lock);
+		} else if (!down_write_trylock(lock)) {
+			err = -EAGAIN;
+			break;
+		}
+		page = simple_get_page(dev, index,
+				       nowait ? GFP_NOWAIT : GFP_KERNEL);
+		if (!page) {
+			up_write(lock);
+			/* Let the caller retry from a context that may sleep */
+			err = nowait ? -EAGAIN : -ENOMEM;
+			break;
+		}
+		copied = copy_page_from_iter(page, page_offset, chunk, from);
+		up_write(lock);
 
-	printk(KERN_INFO "SIMPLE: Wrote %d bytes\n",
-	       bytes_to_write - bytes_not_copied);
+		bytes_written += copied;
+		if (copied < chunk)
+			break;
+	}
 
-	/* Return number of bytes successfully written */
-	return (bytes_to_write - bytes_not_copied);
+	/* Grow the logical size to cover what was written */
+	if (!bytes_written && count)
+		return err;
+	simple_grow_size(dev, pos + bytes_written);
+	return bytes_written;
 }
 
-/* Called when user changes file position with lseek */
-static loff_t char_llseek(struct file *file, loff_t offset, int whence)
+/*
+ * Called for read(), readv(), pread() and friends. A whole scatter-gather
+ * list arrives as one iov_iter, so readv() is a single call into the driver.
+ * io_uring first tries with IOCB_NOWAIT and only punts to a worker thread
+ * if that returns -EAGAIN.
+ */
+static ssize_t char_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
-	loff_t new_pos;
+	size_t count = iov_iter_count(to);
+	loff_t start = iocb->ki_pos;
+	ssize_t ret;
 
-	switch (whence) {
-	case SEEK_SET: /* Set position from start of file */
-		new_pos = offset;
-		break;
-	case SEEK_CUR: /* Set position from current position */
-		new_pos = file->f_pos + offset;
-		break;
-	case SEEK_END: /* Set position from end of file */
-		new_pos = BUFFER_SIZE + offset;
-		break;
-	default:
-		return -EINVAL; /* Invalid argument */
-	}
+	ret = simple_read(iocb->ki_filp->private_data, start, to,
+			  iocb->ki_flags & IOCB_NOWAIT);
 
-	if (new_pos < 0 || new_pos > BUFFER_SIZE)
-		return -EINVAL; /* Invalid position */
+	/* Update file position */
+	if (ret > 0)
+		iocb->ki_pos += ret;
 
-	file->f_pos = new_pos;
-	return new_pos;
+	simple_io_done(iocb->ki_filp, false, start, count, ret);
+	return ret;
 }
 
-/* Module initialization function */
-static int __init simple_char_init(void)
+/* Called for write(), writev(), pwrite() and splice into the device */
+static ssize_t char_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
-	/* Dynamically allocate a major number */
-	major_number = register_chrdev(0, DEVICE_NAME, &simple_fops);
-	if (major_number < 0) {
-		printk(KERN_ALERT
-		       "SIMPLE: Failed to register a major number\n");
-		return major_number;
-	}
-	printk(KERN_INFO "SIMPLE: Registered with major number %d\n",
-	       major_number);
+	size_t count = iov_iter_count(from);
+	loff_t start = iocb->ki_pos;
+	ssize_t ret;
 
-	/* Register the device class - with version-specific API handling */
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
-	/* New API for Linux 6.12 and later */
-	simple_class = class_create(CLASS_NAME);
+	ret = simple_write(iocb->ki_filp->private_data, start, from,
+			   iocb->ki_flags & IOCB_NOWAIT);
+
+	/* Update file position */
+	if (ret > 0)
+		iocb->ki_pos += ret;
+
+	/* Return number of bytes successfully written, or the error */
+	simple_io_done(iocb->ki_filp, true, start, count, ret);
+	return ret;
+}
+
+/*
+ * Build an iov_iter over one user buffer. @iov must outlive @iter on
+ * kernels where the iterator still points at an iovec.
+ */
+static int simple_import(int dir, u64 addr, u32 len, struct iovec *iov,
+			 struct iov_iter *iter)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	return import_ubuf(dir, u64_to_user_ptr(addr), len, iter);
 #else
-	/* Legacy API for Linux kernels before 6.12 */
-	simple_class = class_create(THIS_MODULE, CLASS_NAME);
+	return import_single_range(dir, u64_to_user_ptr(addr), len, iov, iter);
 #endif
-	if (IS_ERR(simple_class)) {
-		unregister_chrdev(major_number, DEVICE_NAME);
-		printk(KERN_ALERT "SIMPLE: Failed to register device class\n");
-		return PTR_ERR(simple_class);
+}
+
+/* Execute one transfer descriptor, returning what pread/pwrite would */
+static ssize_t simple_xfer(struct file *file,
+			   const struct simple_char_xfer *xfer, bool nowait)
+{
+	struct simple_dev *dev = file->private_data;
+	bool write = xfer->op == SIMPLE_CHAR_OP_PUT;
+	struct iov_iter iter;
+	struct iovec iov;
+	ssize_t ret;
+
+	if ((xfer->op != SIMPLE_CHAR_OP_GET && !write) || xfer->reserved)
+		return -EINVAL;
+	if (xfer->offset > MAX_DEVICE_SIZE)
+		return -EINVAL;
+
+	ret = simple_import(write ? ITER_SOURCE : ITER_DEST, xfer->addr,
+			    xfer->len, &iov, &iter);
+	if (ret)
+		return ret;
+
+	if (write)
+		ret = simple_write(dev, xfer->offset, &iter, nowait);
+	else
+		ret = simple_read(dev, xfer->offset, &iter, nowait);
+
+	simple_io_done(file, write, xfer->offset, xfer->len, ret);
+	return ret;
+}
+
+/*
+ * Execute a batch of transfer descriptors in order, storing each result
+ * back into its descriptor. Returns the number of descriptors executed;
+ * a failed transfer does not stop the batch. With @nowait set the batch
+ * stops at the first transfer that would block and returns the number
+ * executed before it, so the caller resumes from there rather than
+ * repeating transfers whose stats and notifications were already emitted.
+ * Only if the very first transfer would block is -EAGAIN returned.
+ */
+static int simple_batch(struct file *file,
+			const struct simple_char_batch *batch, bool nowait)
+{
+	struct simple_char_xfer __user *uxfers = u64_to_user_ptr(batch->xfers);
+	struct simple_char_xfer xfers[8];
+	u32 done = 0;
+
+	if (batch->flags || batch->nr > SIMPLE_CHAR_BATCH_MAX)
+		return -EINVAL;
+
+	/* Work through the array a few descriptors at a time */
+	while (done < batch->nr) {
+		u32 n = min_t(u32, batch->nr - done, ARRAY_SIZE(xfers));
+		u32 i;
+
+		if (copy_from_user(xfers, uxfers + done, n * sizeof(xfers[0])))
+			return -EFAULT;
+
+		for (i = 0; i < n; i++) {
+			ssize_t ret = simple_xfer(file, &xfers[i], nowait);
+
+			if (ret == -EAGAIN && nowait)
+				return done + i ? done + i : -EAGAIN;
+			if (put_user((s32)ret, &uxfers[done + i].result))
+				return -EFAULT;
+		}
+		done += n;
 	}
-	printk(KERN_INFO "SIMPLE: Device class registered\n");
 
-	/* Create the device */
-	simple_device = device_create(
-		simple_class, NULL, MKDEV(major_number, 0), NULL, DEVICE_NAME);
-	if (IS_ERR(simple_device)) {
-		class_destroy(simple_class);
-		unregister_chrdev(major_number, DEVICE_NAME);
-		printk(KERN_ALERT "SIMPLE: Failed to create the device\n");
-		return PTR_ERR(simple_device);
+	return done;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+/* One slice of a direct transfer, run by a worker on system_unbound_wq */
+struct simple_direct_piece {
+	struct work_struct work;
+	struct simple_dev *dev;
+	struct bio_vec *bvec; /* The pinned user buffer, shared by all pieces */
+	unsigned int nr_bvec;
+	bool write;
+	loff_t pos; /* Device offset of this piece */
+	size_t skip; /* Offset of this piece in the user buffer */
+	size_t len;
+	ssize_t ret;
+};
+
+/*
+ * Copy one piece between the pinned user pages and the store. The
+ * iterator walks the bio_vecs, so simple_read() and simple_write() copy
+ * page to page through kmap_local_page, with no user access or faults.
+ */
+static void simple_direct_run(struct simple_direct_piece *piece)
+{
+	struct iov_iter iter;
+	size_t total = piece->skip + piece->len;
+
+	iov_iter_bvec(&iter, piece->write ? ITER_SOURCE : ITER_DEST,
+		      piece->bvec, piece->nr_bvec, total);
+	iov_iter_advance(&iter, piece->skip);
+	iov_iter_truncate(&iter, piece->len);
+
+	if (piece->write)
+		piece->ret = simple_write(piece->dev, piece->pos, &iter, false);
+	else
+		piece->ret = simple_read(piece->dev, piece->pos, &iter, false);
+}
+
+static void simple_direct_work(struct work_struct *work)
+{
+	simple_direct_run(container_of(work, struct simple_direct_piece, work));
+}
+
+/*
+ * Split a large transfer into one piece per online CPU (but no smaller
+ * than DIRECT_PIECE_MIN), run all but the first on the unbound
+ * workqueue and the first in the caller. Returns the bytes copied up to
+ * the first piece that came up short, so the result is a prefix of the
+ * request just as for read() and write().
+ */
+static ssize_t simple_direct_copy(struct simple_dev *dev, bool write,
+				  loff_t pos, struct bio_vec *bvec,
+				  unsigned int nr_bvec, size_t len)
+{
+	struct simple_direct_piece *pieces;
+	size_t piece_len = len;
+	unsigned int nr = 1;
+	ssize_t done = 0;
+	unsigned int i;
+
+	if (len >= DIRECT_SPLIT_MIN && num_online_cpus() > 1) {
+		piece_len = max_t(size_t, DIRECT_PIECE_MIN,
+				  PAGE_ALIGN(DIV_ROUND_UP(len, num_online_cpus())));
+		nr = DIV_ROUND_UP(len, piece_len);
 	}
-	printk(KERN_INFO "SIMPLE: Device created (/dev/%s)\n", DEVICE_NAME);
 
-	/* Initialize character device */
-	cdev_init(&simple_cdev, &simple_fops);
-	simple_cdev.owner = THIS_MODULE;
+	pieces = kcalloc(nr, sizeof(*pieces), GFP_KERNEL);
+	if (!pieces)
+		return -ENOMEM;
 
-	/* Add the character device to the system */
-	if (cdev_add(&simple_cdev, MKDEV(major_number, 0), 1) < 0) {
-		device_destroy(simple_class, MKDEV(major_number, 0));
-		class_destroy(simple_class);
-		unregister_chrdev(major_number, DEVICE_NAME);
-		printk(KERN_ALERT "SIMPLE: Failed to add character device\n");
-		return -EFAULT;
+	for (i = 0; i < nr; i++) {
+		struct simple_direct_piece *piece = &pieces[i];
+
+		piece->dev = dev;
+		piece->bvec = bvec;
+		piece->nr_bvec = nr_bvec;
+		piece->write = write;
+		piece->skip = (size_t)i * piece_len;
+		piece->pos = pos + piece->skip;
+		piece->len = min(piece_len, len - piece->skip);
+		if (i) {
+			INIT_WORK(&piece->work, simple_direct_work);
+			queue_work(system_unbound_wq, &piece->work);
+		}
 	}
 
-	/* Initialize the device buffer */
-	memset(device_buffer, 0, BUFFER_SIZE);
+	simple_direct_run(&pieces[0]);
+	for (i = 1; i < nr; i++)
+		flush_work(&pieces[i].work);
 
-	printk(KERN_INFO "SIMPLE: Character device driver initialized\n");
-	return 0;
+	for (i = 0; i < nr; i++) {
+		if (pieces[i].ret < 0) {
+			if (!done)
+				done = pieces[i].ret;
+			break;
+		}
+		done += pieces[i].ret;
+		if (pieces[i].ret < pieces[i].len)
+			break;
+	}
+
+	kfree(pieces);
+	return done;
 }
 
-/* Module cleanup function */
-static void __exit simple_char_exit(void)
+/*
+ * SIMPLE_CHAR_IOC_DIRECT: move a large buffer without copy_*_user. The
+ * caller's pages are pinned with pin_user_pages_fast() and copied page to
+ * page, in parallel for multi-megabyte transfers. Returns the bytes
+ * transferred, as pread() or pwrite() would.
+ */
+static ssize_t simple_direct(struct file *file,
+			     const struct simple_char_xfer *xfer)
 {
-	/* Remove the character device */
-	cdev_del(&simple_cdev);
+	struct simple_dev *dev = file->private_data;
+	bool write = xfer->op == SIMPLE_CHAR_OP_PUT;
+	unsigned long first = offset_in_page(xfer->addr);
+	struct page **pages = NULL;
+	struct bio_vec *bvec = NULL;
+	size_t len = xfer->len;
+	size_t left;
+	int nr, pinned;
+	ssize_t ret;
+	int i;
+
+	if ((xfer->op != SIMPLE_CHAR_OP_GET && !write) || xfer->reserved)
+		return -EINVAL;
+	if (xfer->offset > MAX_DEVICE_SIZE || len > SIMPLE_CHAR_DIRECT_MAX)
+		return -EINVAL;
+
+	/* Clamp up front, so that every piece is inside the device */
+	if (write) {
+		len = min_t(loff_t, len, MAX_DEVICE_SIZE - xfer->offset);
+		if (!len && xfer->len)
+			return -ENOSPC;
+	} else {
+		loff_t size = atomic64_read(&dev->size);
+
+		len = xfer->offset < size ?
+			min_t(loff_t, len, size - xfer->offset) : 0;
+	}
+	if (!len)
+		return 0;
+
+	nr = DIV_ROUND_UP(first + len, PAGE_SIZE);
+	pages = kvmalloc_array(nr, sizeof(*pages), GFP_KERNEL);
+	bvec = kvmalloc_array(nr, sizeof(*bvec), GFP_KERNEL);
+	if (!pages || !bvec) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* A GET stores into the user pages, so pin them for writing */
+	pinned = pin_user_pages_fast(xfer->addr & PAGE_MASK, nr,
+				     write ? 0 : FOLL_WRITE, pages);
+	if (pinned != nr) {
+		if (pinned > 0)
+			unpin_user_pages(pages, pinned);
+		ret = pinned < 0 ? pinned : -EFAULT;
+		goto out;
+	}
+
+	left = len;
+	for (i = 0; i < nr; i++) {
+		unsigned int off = i ? 0 : first;
+		unsigned int bytes = min_t(size_t, PAGE_SIZE - off, left);
+
+		bvec[i].bv_page = pages[i];
+		bvec[i].bv_len = bytes;
+		bvec[i].bv_offset = off;
+		left -= bytes;
+	}
+
+	ret = simple_direct_copy(dev, write, xfer->offset, bvec, nr, len);
+
+	/* Only a GET stored into the user pages */
+	unpin_user_pages_dirty_lock(pages, nr, !write);
+out:
+	kvfree(bvec);
+	kvfree(pages);
+	return ret;
+}
+#else
+static ssize_t simple_direct(struct file *file,
+			     const struct simple_char_xfer *xfer)
+{
+	/* pin_user_pages_fast() was added in Linux 5.6 */
+	return -EOPNOTSUPP;
+}
+#endif
+
+/*
+ * Called for ioctl(). SIMPLE_CHAR_IOC_BATCH runs many small transfers at
+ * different offsets in one kernel entry, instead of an lseek() and a
+ * read() or write() for each of them. SIMPLE_CHAR_IOC_DIRECT moves one
+ * large buffer through pinned pages.
+ */
+static long char_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct simple_char_batch batch;
+	struct simple_char_xfer xfer;
+	ssize_t ret;
+
+	switch (cmd) {
+	case SIMPLE_CHAR_IOC_BATCH:
+		if (copy_from_user(&batch, (void __user *)arg, sizeof(batch)))
+			return -EFAULT;
+		return simple_batch(file, &batch, false);
+	case SIMPLE_CHAR_IOC_DIRECT:
+		if (copy_from_user(&xfer, (void __user *)arg, sizeof(xfer)))
+			return -EFAULT;
+		ret = simple_direct(file, &xfer);
+		simple_io_done(file, xfer.op == SIMPLE_CHAR_OP_PUT, xfer.offset,
+			       xfer.len, ret);
+		return ret;
+	default:
+		return notify_ioctl(file, cmd, arg);
+	}
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+/*
+ * io_uring passthrough: IORING_OP_URING_CMD with the batch in the SQE.
+ * The first attempt comes with IO_URING_F_NONBLOCK from the submitting
+ * task; returning -EAGAIN makes io_uring retry from a worker thread.
+ */
+static int char_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+	const struct simple_char_batch *sqe_batch = io_uring_sqe_cmd(ioucmd->sqe);
+#else
+	const struct simple_char_batch *sqe_batch = ioucmd->cmd;
+#endif
+	struct simple_char_batch batch;
+
+	if (ioucmd->cmd_op != SIMPLE_CHAR_URING_CMD_BATCH)
+		return -ENOTTY;
+
+	/* The SQE is shared with user space, so read it exactly once */
+	batch.xfers = READ_ONCE(sqe_batch->xfers);
+	batch.nr = READ_ONCE(sqe_batch->nr);
+	batch.flags = READ_ONCE(sqe_batch->flags);
+
+	return simple_batch(ioucmd->file, &batch,
+			    issue_flags & IO_URING_F_NONBLOCK);
+}
+#endif
+
+/* Pipe buffers that reference store pages rather than copies of them */
+static const struct pipe_buf_operations simple_pipe_buf_ops = {
+	.release = generic_pipe_buf_release,
+	.get = generic_pipe_buf_get,
+};
+
+/*
+ * Called for splice() and sendfile() out of the device. Instead of copying,
+ * each store page is handed to the pipe with an extra reference, the same
+ * way the page cache splices file data. Holes are spliced as the shared
+ * zero page. As with files, later writes to a page are visible to pipe
+ * readers that have not consumed it yet.
+ */
+static ssize_t char_splice_read(struct file *in, loff_t *ppos,
+				struct pipe_inode_info *pipe, size_t len,
+				unsigned int flags)
+{
+	struct simple_dev *dev = in->private_data;
+	loff_t size = atomic64_read(&dev->size);
+	loff_t start = *ppos;
+	ssize_t spliced = 0;
+
+	/* Splicing stops at the logical end of the device */
+	len = start < size ? min_t(loff_t, len, size - start) : 0;
+
+	while (len) {
+		pgoff_t index = *ppos >> PAGE_SHIFT;
+		size_t page_offset = offset_in_page(*ppos);
+		struct rw_semaphore *lock = simple_page_lock(dev, index);
+		struct pipe_buffer buf = {
+			.ops = &simple_pipe_buf_ops,
+			.offset = page_offset,
+			.len = min_t(size_t, PAGE_SIZE - page_offset, len),
+		};
+		ssize_t ret;
+
+		down_read(lock);
+		buf.page = xa_load(&dev->pages, index);
+		if (!buf.page)
+			buf.page = ZERO_PAGE(0);
+		get_page(buf.page);
+		up_read(lock);
+
+		/* add_to_pipe() drops our reference if the pipe is full */
+		ret = add_to_pipe(pipe, &buf);
+		if (ret < 0) {
+			if (!spliced)
+				spliced = ret;
+			break;
+		}
+
+		*ppos += ret;
+		spliced += ret;
+		len -= ret;
+	}
+
+	simple_io_done(in, false, start, spliced > 0 ? spliced : 0, spliced);
+	return spliced;
+}
+
+/* Called when user changes file position with lseek */
+static loff_t char_llseek(struct file *file, loff_t offset, int whence)
+{
+	struct simple_dev *dev = file->private_data;
+	loff_t new_pos;
+
+	switch (whence) {
+	case SEEK_SET: /* Set position from start of file */
+		new_pos = offset;
+		break;
+	case SEEK_CUR: /* Set position from current position */
+		new_pos = file->f_pos + offset;
+		break;
+	case SEEK_END: /* Set position from end of file */
+		new_pos = atomic64_read(&dev->size) + offset;
+		break;
+	default:
+		return -EINVAL; /* Invalid argument */
+	}
+
+	if (new_pos < 0 || new_pos > MAX_DEVICE_SIZE)
+		return -EINVAL; /* Invalid position */
+
+	file->f_pos = new_pos;
+	return new_pos;
+}
+
+/* Called when a mapped page is first touched */
+static vm_fault_t char_vm_fault(struct vm_fault *vmf)
+{
+	struct simple_dev *dev = vmf->vma->vm_file->private_data;
+	struct page *page;
+
+	if (vmf->pgoff >= MAX_DEVICE_PAGES)
+		return VM_FAULT_SIGBUS;
+
+	/* Faulting a page in populates it, just like a write would */
+	page = simple_get_page(dev, vmf->pgoff, GFP_KERNEL);
+	if (!page)
+		return VM_FAULT_OOM;
+
+	/* The mapping holds its own reference on the page */
+	get_page(page);
+	vmf->page = page;
+	return 0;
+}
+
+static const struct vm_operations_struct simple_vm_ops = {
+	.fault = char_vm_fault,
+};
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * 4 KB fault in huge page mode. The mapping is VM_PFNMAP so that 2 MB
+ * pages can be inserted whole, which means small pages are inserted by
+ * PFN too. No page references are taken; the pages stay in the store
+ * until the module is unloaded, which cannot happen while a mapping
+ * holds the file open.
+ */
+static vm_fault_t char_pfn_fault(struct vm_fault *vmf)
+{
+	struct simple_dev *dev = vmf->vma->vm_file->private_data;
+	struct page *page;
+
+	if (vmf->pgoff >= MAX_DEVICE_PAGES)
+		return VM_FAULT_SIGBUS;
+
+	page = simple_get_page(dev, vmf->pgoff, GFP_KERNEL);
+	if (!page)
+		return VM_FAULT_OOM;
+
+	return vmf_insert_pfn(vmf->vma, vmf->address, page_to_pfn(page));
+}
+
+static const struct vm_operations_struct simple_huge_vm_ops = {
+	.fault = char_pfn_fault,
+	.huge_fault = char_huge_fault,
+};
+#endif
+
+/* Called when user maps the device with mmap() */
+static int char_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	/* The mapping must fit inside the maximum device size */
+	if (vma->vm_pgoff + vma_pages(vma) > MAX_DEVICE_PAGES)
+		return -EINVAL;
+
+	/*
+	 * Pages are mapped lazily by char_vm_fault. With MAP_SHARED, user
+	 * space sees the same pages that char_read and char_write copy to
+	 * and from, so no syscall or copy is needed. Stores through the
+	 * mapping do not change the logical size of the device.
+	 */
+	vma->vm_ops = &simple_vm_ops;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	/* With a huge page region, map it with PMDs to save TLB entries */
+	if (huge_size_mb) {
+		/*
+		 * A PFN mapping cannot be copy-on-write, so unlike the
+		 * ordinary page mappings this one must be MAP_SHARED
+		 */
+		if (!(vma->vm_flags & VM_SHARED))
+			return -EINVAL;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+		vm_flags_set(vma, VM_PFNMAP | VM_HUGEPAGE | VM_DONTEXPAND |
+					  VM_DONTDUMP);
+#else
+		vma->vm_flags |= VM_PFNMAP | VM_HUGEPAGE | VM_DONTEXPAND |
+				 VM_DONTDUMP;
+#endif
+		vma->vm_ops = &simple_huge_vm_ops;
+	}
+#endif
+	return 0;
+}
+
+/* Bytes currently queued in the FIFO */
+static unsigned int fifo_used(struct simple_fifo *fifo)
+{
+	return smp_load_acquire(&fifo->head) - smp_load_acquire(&fifo->tail);
+}
+
+/* Called when the device is opened in FIFO mode */
+static int fifo_open(struct inode *inode, struct file *file)
+{
+	file->private_data =
+		container_of(inode->i_cdev, struct simple_dev, cdev);
+	trace_simple_char_open(iminor(inode), file->f_flags);
+
+	/* io_uring may issue inline, an empty or full ring gives -EAGAIN */
+	file->f_mode |= FMODE_NOWAIT;
+
+	/* A FIFO has no file position, like a pipe */
+	return stream_open(inode, file);
+}
+
+/* Take a FIFO side lock, without sleeping if @nowait is set */
+static int fifo_lock(struct mutex *lock, bool nowait)
+{
+	if (nowait)
+		return mutex_trylock(lock) ? 0 : -EAGAIN;
+	return mutex_lock_interruptible(lock) ? -ERESTARTSYS : 0;
+}
+
+/*
+ * Dequeue data from the FIFO into @to. @nowait (IOCB_NOWAIT) behaves like
+ * O_NONBLOCK and additionally never sleeps on the side lock.
+ */
+static ssize_t fifo_read(struct file *file, struct iov_iter *to, bool nowait)
+{
+	struct simple_dev *dev = file->private_data;
+	struct simple_fifo *fifo = &dev->fifo;
+	unsigned int head, tail, index, first;
+	size_t count = iov_iter_count(to);
+	size_t bytes_read;
+	int ret;
+
+	if (!count)
+		return 0;
+
+	ret = fifo_lock(&fifo->read_lock, nowait);
+	if (ret)
+		return ret;
+
+	/* Block until the producer has published some data */
+	while (fifo_used(fifo) == 0) {
+		mutex_unlock(&fifo->read_lock);
+		if (nowait || (file->f_flags & O_NONBLOCK))
+			return -EAGAIN;
+		if (wait_event_interruptible(fifo->read_wq, fifo_used(fifo) != 0))
+			return -ERESTARTSYS;
+		if (mutex_lock_interruptible(&fifo->read_lock))
+			return -ERESTARTSYS;
+	}
+
+	/* Acquire pairs with the producer's release of head */
+	head = smp_load_acquire(&fifo->head);
+	tail = fifo->tail;
+	count = min_t(size_t, count, head - tail);
+
+	/* Copy out, wrapping around the end of the ring if needed */
+	index = tail & (fifo->size - 1);
+	first = min_t(size_t, count, fifo->size - index);
+	bytes_read = copy_to_iter(fifo->data + index, first, to);
+	if (bytes_read == first && count > first)
+		bytes_read += copy_to_iter(fifo->data, count - first, to);
+
+	/* Release hands the consumed space back to the producer */
+	smp_store_release(&fifo->tail, tail + bytes_read);
+	mutex_unlock(&fifo->read_lock);
+
+	if (!bytes_read)
+		return -EFAULT;
+
+	/* Only pay for a wakeup if a writer is actually waiting */
+	if (wq_has_sleeper(&fifo->write_wq))
+		wake_up_interruptible_poll(&fifo->write_wq,
+					   EPOLLOUT | EPOLLWRNORM);
+
+	return bytes_read;
+}
+
+/* Queue the data in @from into the FIFO, @nowait as for fifo_read() */
+static ssize_t fifo_write(struct file *file, struct iov_iter *from,
+			  bool nowait)
+{
+	struct simple_dev *dev = file->private_data;
+	struct simple_fifo *fifo = &dev->fifo;
+	size_t count = iov_iter_count(from);
+	size_t bytes_written = 0;
+	ssize_t err;
+
+	err = fifo_lock(&fifo->write_lock, nowait);
+	if (err)
+		return err;
+
+	/* Blocking writers keep going until everything is queued */
+	while (bytes_written < count) {
+		unsigned int head, tail, index, first, space;
+		size_t chunk, copied;
+
+		if (fifo_used(fifo) == fifo->size) {
+			mutex_unlock(&fifo->write_lock);
+			if (nowait || (file->f_flags & O_NONBLOCK)) {
+				err = -EAGAIN;
+				goto out;
+			}
+			if (wait_event_interruptible(fifo->write_wq,
+						     fifo_used(fifo) != fifo->size)) {
+				err = -ERESTARTSYS;
+				goto out;
+			}
+			if (mutex_lock_interruptible(&fifo->write_lock)) {
+				err = -ERESTARTSYS;
+				goto out;
+			}
+			continue;
+		}
+
+		/* Acquire pairs with the consumer's release of tail */
+		tail = smp_load_acquire(&fifo->tail);
+		head = fifo->head;
+		space = fifo->size - (head - tail);
+		chunk = min_t(size_t, count - bytes_written, space);
+
+		/* Copy in, wrapping around the end of the ring if needed */
+		index = head & (fifo->size - 1);
+		first = min_t(size_t, chunk, fifo->size - index);
+		copied = copy_from_iter(fifo->data + index, first, from);
+		if (copied == first && chunk > first)
+			copied += copy_from_iter(fifo->data, chunk - first, from);
+
+		/* Release publishes the data before the new head */
+		smp_store_release(&fifo->head, head + copied);
+		bytes_written += copied;
+
+		/* Only pay for a wakeup if a reader is actually waiting */
+		if (copied && wq_has_sleeper(&fifo->read_wq))
+			wake_up_interruptible_poll(&fifo->read_wq,
+						   EPOLLIN | EPOLLRDNORM);
+
+		if (copied < chunk) {
+			err = -EFAULT;
+			break;
+		}
+	}
+	mutex_unlock(&fifo->write_lock);
+
+out:
+	/* Report partial progress rather than the error, like pipes do */
+	return bytes_written ? bytes_written : err;
+}
+
+/* Called when user reads from the device in FIFO mode */
+static ssize_t fifo_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	size_t count = iov_iter_count(to);
+	ssize_t ret = fifo_read(iocb->ki_filp, to,
+				iocb->ki_flags & IOCB_NOWAIT);
+
+	simple_io_done(iocb->ki_filp, false, 0, count, ret);
+	return ret;
+}
+
+/* Called when user writes to the device in FIFO mode */
+static ssize_t fifo_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	size_t count = iov_iter_count(from);
+	ssize_t ret = fifo_write(iocb->ki_filp, from,
+				 iocb->ki_flags & IOCB_NOWAIT);
+
+	simple_io_done(iocb->ki_filp, true, 0, count, ret);
+	return ret;
+}
+
+/* Called by poll(), select() and epoll in FIFO mode */
+static __poll_t fifo_poll(struct file *file, poll_table *wait)
+{
+	struct simple_dev *dev = file->private_data;
+	struct simple_fifo *fifo = &dev->fifo;
+	__poll_t mask = 0;
+	unsigned int used;
+
+	poll_wait(file, &fifo->read_wq, wait);
+	poll_wait(file, &fifo->write_wq, wait);
+
+	used = fifo_used(fifo);
+	if (used)
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (used < fifo->size)
+		mask |= EPOLLOUT | EPOLLWRNORM;
+
+	return mask;
+}
+
+/* Set up the FIFO ring buffer on the device's node */
+static int fifo_init(struct simple_dev *dev)
+{
+	struct simple_fifo *fifo = &dev->fifo;
+
+	fifo->data = vmalloc_node(fifo_size, dev->node);
+	if (!fifo->data)
+		return -ENOMEM;
+
+	fifo->size = fifo_size;
+	fifo->head = 0;
+	fifo->tail = 0;
+	mutex_init(&fifo->read_lock);
+	mutex_init(&fifo->write_lock);
+	init_waitqueue_head(&fifo->read_wq);
+	init_waitqueue_head(&fifo->write_wq);
+	return 0;
+}
+
+/* Per-file state of a log reader: how far it has read in each shard */
+struct simple_log_reader {
+	struct mutex lock; /* Serializes reads through one file */
+	unsigned int gen; /* log_gen the cursors belong to */
+	unsigned int pos[]; /* Indexed by CPU */
+};
+
+/* A merged snapshot of the log mapped into user space */
+struct simple_log_snapshot {
+	refcount_t ref; /* One per vma referencing the snapshot */
+	void *data;
+};
+
+/* Called when the device is opened in log mode */
+static int log_open(struct inode *inode, struct file *file)
+{
+	struct simple_dev *dev =
+		container_of(inode->i_cdev, struct simple_dev, cdev);
+	struct simple_log_reader *reader;
+
+	reader = kzalloc(struct_size(reader, pos, nr_cpu_ids), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+	mutex_init(&reader->lock);
+	reader->gen = READ_ONCE(dev->log_gen);
+	file->private_data = reader;
+
+	trace_simple_char_open(iminor(inode), file->f_flags);
+
+	/* Readers see a merged stream of records, there is no position */
+	return stream_open(inode, file);
+}
+
+/* Called when the device is closed in log mode */
+static int log_release(struct inode *inode, struct file *file)
+{
+	simple_notify_release(file);
+	kfree(file->private_data);
+	trace_simple_char_release(iminor(inode));
+	return 0;
+}
+
+/*
+ * Append one record, holding the whole write() payload. The record is
+ * copied with preemption disabled, so no other writer can use this CPU's
+ * shard meanwhile, and with page faults disabled, since we cannot sleep.
+ * If the user buffer is not resident the copy comes up short; the source
+ * is then faulted in with preemption enabled and the append retried,
+ * possibly on another CPU. A record is all or nothing, so a source that
+ * cannot be faulted in completely fails with -EFAULT rather than retrying.
+ */
+static ssize_t log_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct simple_dev *dev = simple_file_dev(iocb->ki_filp);
+	size_t len = iov_iter_count(from);
+	size_t size = SIMPLE_CHAR_LOG_REC_SIZE(len);
+	ssize_t ret;
+
+	if (!len) {
+		ret = 0;
+		goto out;
+	}
+	if (len > SIMPLE_CHAR_LOG_MAX_LEN) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (;;) {
+		struct simple_log_shard *shard = get_cpu_ptr(dev->log);
+		struct simple_char_log_rec *rec;
+		unsigned int head = shard->head;
+		size_t copied;
+
+		if (head + size > log_size) {
+			put_cpu_ptr(dev->log);
+			ret = -ENOSPC;
+			break;
+		}
+
+		rec = (struct simple_char_log_rec *)(shard->data + head);
+		pagefault_disable();
+		copied = copy_from_iter(rec + 1, len, from);
+		pagefault_enable();
+
+		if (copied == len) {
+			rec->ts = ktime_get_ns();
+			rec->cpu = smp_processor_id();
+			rec->len = len;
+			/* Publish the complete record to readers */
+			smp_store_release(&shard->head, head + size);
+			put_cpu_ptr(dev->log);
+			ret = len;
+			break;
+		}
+		put_cpu_ptr(dev->log);
+
+		iov_iter_revert(from, copied);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+		if (fault_in_iov_iter_readable(from, len)) {
+#else
+		if (iov_iter_fault_in_readable(from, len)) {
+#endif
+			ret = -EFAULT;
+			break;
+		}
+	}
+
+out:
+	simple_io_done(iocb->ki_filp, true, 0, len, ret);
+	return ret;
+}
+
+/*
+ * Find the oldest record not yet consumed by the cursors in @pos, looking
+ * no further than @limit in each shard (or the published head if @limit is
+ * NULL). Returns NULL once every shard is drained, otherwise stores the
+ * record's shard in @cpu_out and its size in @size_out.
+ */
+static const struct simple_char_log_rec *
+log_next(struct simple_dev *dev, const unsigned int *pos,
+	 const unsigned int *limit, int *cpu_out, size_t *size_out)
+{
+	const struct simple_char_log_rec *best = NULL;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct simple_log_shard *shard = per_cpu_ptr(dev->log, cpu);
+		unsigned int end = limit ? limit[cpu] :
+					   smp_load_acquire(&shard->head);
+		const struct simple_char_log_rec *rec;
+		u32 len;
+
+		if (pos[cpu] + sizeof(*rec) > end)
+			continue;
+		rec = (const void *)(shard->data + pos[cpu]);
+
+		/*
+		 * A cursor left over from a reset may point into the middle
+		 * of a record, so never trust a length that runs past the end.
+		 */
+		len = READ_ONCE(rec->len);
+		if (len > SIMPLE_CHAR_LOG_MAX_LEN ||
+		    pos[cpu] + SIMPLE_CHAR_LOG_REC_SIZE(len) > end)
+			continue;
+
+		if (!best || rec->ts < best->ts) {
+			best = rec;
+			*cpu_out = cpu;
+			*size_out = SIMPLE_CHAR_LOG_REC_SIZE(len);
+		}
+	}
+
+	return best;
+}
+
+/*
+ * Return whole records in timestamp order, merging the shards. Each read
+ * continues after the last record this file returned; 0 means the reader
+ * has caught up. A buffer too small for the next record gets -EINVAL.
+ */
+static ssize_t log_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct simple_log_reader *reader = iocb->ki_filp->private_data;
+	struct simple_dev *dev = simple_file_dev(iocb->ki_filp);
+	size_t count = iov_iter_count(to);
+	size_t bytes_read = 0;
+	ssize_t ret = 0;
+
+	if (mutex_lock_interruptible(&reader->lock))
+		return -ERESTARTSYS;
+
+	/* After a reset, start again from the beginning of every shard */
+	if (reader->gen != READ_ONCE(dev->log_gen)) {
+		reader->gen = READ_ONCE(dev->log_gen);
+		memset(reader->pos, 0, nr_cpu_ids * sizeof(reader->pos[0]));
+	}
+
+	for (;;) {
+		const struct simple_char_log_rec *rec;
+		size_t size;
+		int cpu;
+
+		rec = log_next(dev, reader->pos, NULL, &cpu, &size);
+		if (!rec)
+			break;
+
+		if (size > iov_iter_count(to)) {
+			if (!bytes_read)
+				ret = -EINVAL;
+			break;
+		}
+		if (copy_to_iter(rec, size, to) != size) {
+			ret = -EFAULT;
+			break;
+		}
+		reader->pos[cpu] += size;
+		bytes_read += size;
+	}
+	mutex_unlock(&reader->lock);
+
+	if (bytes_read)
+		ret = bytes_read;
+	simple_io_done(iocb->ki_filp, false, 0, count, ret);
+	return ret;
+}
+
+static void log_vm_open(struct vm_area_struct *vma)
+{
+	struct simple_log_snapshot *snap = vma->vm_private_data;
+
+	refcount_inc(&snap->ref);
+}
+
+/* Free the snapshot once the last vma using it is gone */
+static void log_vm_close(struct vm_area_struct *vma)
+{
+	struct simple_log_snapshot *snap = vma->vm_private_data;
+
+	if (refcount_dec_and_test(&snap->ref)) {
+		vfree(snap->data);
+		kfree(snap);
+	}
+}
+
+static const struct vm_operations_struct simple_log_vm_ops = {
+	.open = log_vm_open,
+	.close = log_vm_close,
+};
+
+/*
+ * Map a merged, timestamp-ordered snapshot of every record published so
+ * far, in the same format read() returns, padded with zeros to the size
+ * of the mapping. Later appends do not show up in an existing mapping.
+ */
+static int log_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct simple_dev *dev = simple_file_dev(file);
+	unsigned long len = vma->vm_end - vma->vm_start;
+	struct simple_log_snapshot *snap;
+	unsigned int *pos, *limit;
+	size_t total = 0, done = 0;
+	int cpu, ret;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	pos = kcalloc(nr_cpu_ids, sizeof(*pos), GFP_KERNEL);
+	limit = kcalloc(nr_cpu_ids, sizeof(*limit), GFP_KERNEL);
+	snap = kzalloc(sizeof(*snap), GFP_KERNEL);
+	if (!pos || !limit || !snap) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* Fix the end of each shard, so appends racing with us are left out */
+	for_each_possible_cpu(cpu) {
+		limit[cpu] = smp_load_acquire(&per_cpu_ptr(dev->log, cpu)->head);
+		total += limit[cpu];
+	}
+
+	snap->data = vmalloc_user(max_t(size_t, total, len));
+	if (!snap->data) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (;;) {
+		const struct simple_char_log_rec *rec;
+		size_t size;
+
+		rec = log_next(dev, pos, limit, &cpu, &size);
+		if (!rec)
+			break;
+		memcpy(snap->data + done, rec, size);
+		pos[cpu] += size;
+		done += size;
+	}
+
+	ret = remap_vmalloc_range(vma, snap->data, 0);
+	if (ret) {
+		vfree(snap->data);
+		goto out;
+	}
+
+	refcount_set(&snap->ref, 1);
+	vma->vm_private_data = snap;
+	vma->vm_ops = &simple_log_vm_ops;
+	snap = NULL;
+
+out:
+	kfree(snap);
+	kfree(limit);
+	kfree(pos);
+	return ret;
+}
+
+/* Empty one CPU's shard; runs on that CPU, so no append is in progress */
+static int log_reset_cpu(void *data)
+{
+	struct simple_dev *dev = data;
+
+	smp_store_release(&this_cpu_ptr(dev->log)->head, 0);
+	return 0;
+}
+
+/* Called for ioctl() in log mode */
+static long log_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct simple_dev *dev = simple_file_dev(file);
+	int cpu;
+
+	switch (cmd) {
+	case SIMPLE_CHAR_IOC_LOG_RESET:
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		/*
+		 * An append runs with preemption disabled, so a function
+		 * executed in process context on the shard's own CPU cannot
+		 * land in the middle of one.
+		 */
+		cpus_read_lock();
+		for_each_online_cpu(cpu)
+			smp_call_on_cpu(cpu, log_reset_cpu, dev, false);
+		cpus_read_unlock();
+		for_each_possible_cpu(cpu) {
+			if (!cpu_online(cpu))
+				per_cpu_ptr(dev->log, cpu)->head = 0;
+		}
+		WRITE_ONCE(dev->log_gen, dev->log_gen + 1);
+		return 0;
+	default:
+		return notify_ioctl(file, cmd, arg);
+	}
+}
+
+/* Set up one shard per possible CPU, each on that CPU's node */
+static int log_init(struct simple_dev *dev)
+{
+	int cpu;
+
+	dev->log = alloc_percpu(struct simple_log_shard);
+	if (!dev->log)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct simple_log_shard *shard = per_cpu_ptr(dev->log, cpu);
+
+		shard->data = vzalloc_node(log_size, cpu_to_node(cpu));
+		if (!shard->data)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+/* Free the log shards */
+static void log_free(struct simple_dev *dev)
+{
+	int cpu;
+
+	if (!dev->log)
+		return;
+	for_each_possible_cpu(cpu)
+		vfree(per_cpu_ptr(dev->log, cpu)->data);
+	free_percpu(dev->log);
+}
+
+/* Per-file state in snapshot mode: the version this file is reading */
+struct simple_snap_file {
+	spinlock_t lock; /* Protects pinned */
+	struct simple_version *pinned;
+};
+
+/* Allocate an empty version with room for @nr_chunks chunks */
+static struct simple_version *simple_version_alloc(struct simple_dev *dev,
+						   unsigned long nr_chunks)
+{
+	struct simple_version *v;
+
+	v = kvzalloc_node(struct_size(v, chunks, nr_chunks), GFP_KERNEL,
+			  dev->node);
+	if (!v)
+		return NULL;
+	kref_init(&v->ref);
+	v->nr_chunks = nr_chunks;
+	return v;
+}
+
+static void simple_snap_chunk_put(struct simple_snap_chunk *chunk)
+{
+	unsigned long i;
+
+	if (!chunk || !refcount_dec_and_test(&chunk->ref))
+		return;
+	for (i = 0; i < SNAP_CHUNK_PAGES; i++) {
+		if (chunk->pages[i])
+			put_page(chunk->pages[i]);
+	}
+	kfree(chunk);
+}
+
+static void simple_version_free_rcu(struct rcu_head *rcu)
+{
+	struct simple_version *v = container_of(rcu, struct simple_version, rcu);
+	unsigned long i;
+
+	for (i = 0; i < v->nr_chunks; i++)
+		simple_snap_chunk_put(v->chunks[i]);
+	kvfree(v);
+}
+
+/* Last reference gone: free once no RCU reader can still see @v */
+static void simple_version_release(struct kref *ref)
+{
+	struct simple_version *v = container_of(ref, struct simple_version, ref);
+
+	call_rcu(&v->rcu, simple_version_free_rcu);
+}
+
+static void simple_version_put(struct simple_version *v)
+{
+	if (v)
+		kref_put(&v->ref, simple_version_release);
+}
+
+/*
+ * Pin the current version. The kref may drop to zero between
+ * rcu_dereference() and kref_get_unless_zero() if a writer has just
+ * replaced it, in which case the newer version is picked up instead.
+ */
+static struct simple_version *simple_version_get(struct simple_dev *dev)
+{
+	struct simple_version *v;
+
+	rcu_read_lock();
+	do {
+		v = rcu_dereference(dev->version);
+	} while (!kref_get_unless_zero(&v->ref));
+	rcu_read_unlock();
+
+	return v;
+}
+
+/* Called when the device is opened in snapshot mode */
+static int snap_open(struct inode *inode, struct file *file)
+{
+	struct simple_snap_file *sf;
+
+	sf = kzalloc(sizeof(*sf), GFP_KERNEL);
+	if (!sf)
+		return -ENOMEM;
+	spin_lock_init(&sf->lock);
+	file->private_data = sf;
+
+	file->f_mode |= FMODE_ATOMIC_POS;
+	trace_simple_char_open(iminor(inode), file->f_flags);
+	return 0;
+}
+
+/* Called when the device is closed in snapshot mode */
+static int snap_release(struct inode *inode, struct file *file)
+{
+	struct simple_snap_file *sf = file->private_data;
+
+	simple_notify_release(file);
+	simple_version_put(sf->pinned);
+	kfree(sf);
+	trace_simple_char_release(iminor(inode));
+	return 0;
+}
+
+/*
+ * Take a reference on the version this read should use. A read from
+ * offset 0 starts a new snapshot of the latest version; later reads keep
+ * using it, so reading the device from start to end sees one consistent
+ * buffer however many writes complete meanwhile.
+ */
+static struct simple_version *snap_pin(struct simple_snap_file *sf,
+				       struct simple_dev *dev, loff_t pos)
+{
+	struct simple_version *v, *old = NULL;
+
+	spin_lock(&sf->lock);
+	if (pos != 0 && sf->pinned) {
+		v = sf->pinned;
+		kref_get(&v->ref);
+		spin_unlock(&sf->lock);
+		return v;
+	}
+	spin_unlock(&sf->lock);
+
+	v = simple_version_get(dev);
+	kref_get(&v->ref); /* One for the file, one for the caller */
+
+	spin_lock(&sf->lock);
+	old = sf->pinned;
+	sf->pinned = v;
+	spin_unlock(&sf->lock);
+
+	simple_version_put(old);
+	return v;
+}
+
+/* Called for read() in snapshot mode; never waits for a writer */
+static ssize_t snap_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct simple_dev *dev = simple_file_dev(iocb->ki_filp);
+	struct simple_version *v;
+	size_t count = iov_iter_count(to);
+	loff_t start = iocb->ki_pos;
+	size_t bytes_read = 0;
+	ssize_t ret;
+
+	v = snap_pin(iocb->ki_filp->private_data, dev, start);
+
+	/* Reads stop at the end of the pinned version */
+	count = start < v->size ? min_t(loff_t, count, v->size - start) : 0;
+
+	while (bytes_read < count) {
+		loff_t pos = start + bytes_read;
+		size_t page_offset = offset_in_page(pos);
+		size_t chunk = min_t(size_t, PAGE_SIZE - page_offset,
+				     count - bytes_read);
+		pgoff_t index = pos >> PAGE_SHIFT;
+		struct simple_snap_chunk *tbl;
+		struct page *page = NULL;
+		size_t copied;
+
+		/* Two lookups: the chunk, then the page within it */
+		tbl = v->chunks[index >> SNAP_CHUNK_SHIFT];
+		if (tbl)
+			page = tbl->pages[index & (SNAP_CHUNK_PAGES - 1)];
+
+		if (page)
+			copied = copy_page_to_iter(page, page_offset, chunk, to);
+		else
+			copied = iov_iter_zero(chunk, to);
+
+		bytes_read += copied;
+		if (copied < chunk)
+			break;
+	}
+	simple_version_put(v);
+
+	iocb->ki_pos += bytes_read;
+	ret = (!bytes_read && count) ? -EFAULT : bytes_read;
+	simple_io_done(iocb->ki_filp, false, start, count, ret);
+	return ret;
+}
+
+/* Fill @page from @offset on with the old contents, or zeroes for a hole */
+static void snap_fill_tail(struct page *page, struct page *old, size_t offset)
+{
+	void *dst, *src;
+
+	if (!old) {
+		zero_user_segment(page, offset, PAGE_SIZE);
+		return;
+	}
+	dst = kmap_local_page(page);
+	src = kmap_local_page(old);
+	memcpy(dst + offset, src + offset, PAGE_SIZE - offset);
+	kunmap_local(src);
+	kunmap_local(dst);
+}
+
+/*
+ * Give @new a private copy of chunk @ci that it may modify, unless it
+ * already has one. A chunk still shared with @old is copied, taking a
+ * reference on each of its pages; a hole gets an empty chunk.
+ */
+static struct simple_snap_chunk *
+snap_chunk_cow(struct simple_dev *dev, struct simple_version *new,
+	       const struct simple_version *old, unsigned long ci)
+{
+	struct simple_snap_chunk *shared = new->chunks[ci], *tbl;
+	unsigned long i;
+
+	if (shared && (ci >= old->nr_chunks || shared != old->chunks[ci]))
+		return shared;
+
+	tbl = kzalloc_node(sizeof(*tbl), GFP_KERNEL, dev->node);
+	if (!tbl)
+		return NULL;
+	refcount_set(&tbl->ref, 1);
+	if (shared) {
+		for (i = 0; i < SNAP_CHUNK_PAGES; i++) {
+			tbl->pages[i] = shared->pages[i];
+			if (tbl->pages[i])
+				get_page(tbl->pages[i]);
+		}
+		simple_snap_chunk_put(shared);
+	}
+	new->chunks[ci] = tbl;
+	return tbl;
+}
+
+/*
+ * Called for write() in snapshot mode. Builds a new version that shares
+ * every untouched chunk with the current one, copies the chunks the write
+ * touches, puts the data into fresh pages and publishes the result in one
+ * pointer store. Readers of the old version are unaffected. The cost of a
+ * write is one pointer per 2 MB of device plus the chunks it touches.
+ */
+static ssize_t snap_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct simple_dev *dev = simple_file_dev(iocb->ki_filp);
+	struct simple_version *old, *new;
+	size_t count = iov_iter_count(from);
+	loff_t start = iocb->ki_pos;
+	size_t bytes_written = 0;
+	unsigned long i;
+	ssize_t ret;
+
+	if (start >= MAX_DEVICE_SIZE) {
+		ret = -ENOSPC;
+		goto out;
+	}
+	count = min_t(loff_t, count, MAX_DEVICE_SIZE - start);
+
+	if (mutex_lock_interruptible(&dev->version_lock)) {
+		ret = -ERESTARTSYS;
+		goto out;
+	}
+	old = rcu_dereference_protected(dev->version,
+					lockdep_is_held(&dev->version_lock));
+
+	new = simple_version_alloc(dev,
+		max_t(unsigned long, old->nr_chunks,
+		      DIV_ROUND_UP(start + count,
+				   PAGE_SIZE << SNAP_CHUNK_SHIFT)));
+	if (!new) {
+		mutex_unlock(&dev->version_lock);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* Share the current chunks */
+	for (i = 0; i < old->nr_chunks; i++) {
+		new->chunks[i] = old->chunks[i];
+		if (new->chunks[i])
+			refcount_inc(&new->chunks[i]->ref);
+	}
+
+	/* Copy on write: every page the write touches is replaced */
+	ret = -EFAULT;
+	while (bytes_written < count) {
+		loff_t pos = start + bytes_written;
+		size_t page_offset = offset_in_page(pos);
+		size_t chunk = min_t(size_t, PAGE_SIZE - page_offset,
+				     count - bytes_written);
+		pgoff_t index = pos >> PAGE_SHIFT;
+		struct simple_snap_chunk *tbl;
+		struct page *page, **slot;
+		size_t copied;
+
+		tbl = snap_chunk_cow(dev, new, old, index >> SNAP_CHUNK_SHIFT);
+		page = NULL;
+		if (tbl)
+			page = alloc_pages_node(dev->node, GFP_HIGHUSER, 0);
+		if (!page) {
+			ret = -ENOMEM;
+			break;
+		}
+		slot = &tbl->pages[index & (SNAP_CHUNK_PAGES - 1)];
+		if (chunk < PAGE_SIZE) {
+			if (*slot)
+				copy_highpage(page, *slot);
+			else
+				clear_highpage(page);
+		}
+
+		copied = copy_page_from_iter(page, page_offset, chunk, from);
+		if (!copied) {
+			put_page(page);
+			break;
+		}
+		/*
+		 * A full-page chunk skipped seeding the new page, so a short
+		 * copy must fill the rest from the version being replaced.
+		 */
+		if (copied < chunk && chunk == PAGE_SIZE)
+			snap_fill_tail(page, *slot, copied);
+		if (*slot)
+			put_page(*slot);
+		*slot = page;
+
+		bytes_written += copied;
+		if (copied < chunk)
+			break;
+	}
+
+	if (!bytes_written && count) {
+		mutex_unlock(&dev->version_lock);
+		simple_version_put(new);
+		goto out;
+	}
+
+	new->size = max_t(loff_t, old->size, start + bytes_written);
+	rcu_assign_pointer(dev->version, new);
+	mutex_unlock(&dev->version_lock);
+
+	/* Freed once the last reader pinning it lets go */
+	simple_version_put(old);
+
+	iocb->ki_pos += bytes_written;
+	ret = bytes_written;
+
+out:
+	simple_io_done(iocb->ki_filp, true, start, count, ret);
+	return ret;
+}
+
+/* Called for lseek() in snapshot mode */
+static loff_t snap_llseek(struct file *file, loff_t offset, int whence)
+{
+	struct simple_dev *dev = simple_file_dev(file);
+	struct simple_version *v;
+	loff_t size;
+
+	/* SEEK_END follows the latest version */
+	v = simple_version_get(dev);
+	size = v->size;
+	simple_version_put(v);
+
+	return generic_file_llseek_size(file, offset, whence, MAX_DEVICE_SIZE,
+					size);
+}
+
+/* Publish the initial, empty version */
+static int snap_init(struct simple_dev *dev)
+{
+	struct simple_version *v = simple_version_alloc(dev, 0);
+
+	if (!v)
+		return -ENOMEM;
+	mutex_init(&dev->version_lock);
+	RCU_INIT_POINTER(dev->version, v);
+	return 0;
+}
+
+#if IS_ENABLED(CONFIG_LZ4_COMPRESS) && IS_ENABLED(CONFIG_LZ4_DECOMPRESS)
+/*
+ * Compress the page of @hot into the cold store, replacing any older
+ * copy. A page LZ4 cannot shrink is stored as is. @gfp is the caller's,
+ * so an IOCB_NOWAIT request never sleeps in reclaim here.
+ */
+static int comp_store(struct simple_comp *comp, struct simple_hot_page *hot,
+		      gfp_t gfp)
+{
+	struct simple_comp_page *cp, *old;
+	void *src = kmap_local_page(hot->page);
+	int len;
+
+	len = LZ4_compress_default(src, comp->scratch, PAGE_SIZE,
+				   LZ4_COMPRESSBOUND(PAGE_SIZE), comp->wrkmem);
+	if (len <= 0 || len >= PAGE_SIZE)
+		len = PAGE_SIZE;
+
+	cp = kmalloc(struct_size(cp, data, len), gfp);
+	if (!cp) {
+		kunmap_local(src);
+		return -ENOMEM;
+	}
+	cp->len = len;
+	memcpy(cp->data, len == PAGE_SIZE ? src : comp->scratch, len);
+	kunmap_local(src);
+
+	old = xa_store(&comp->cold, hot->index, cp, gfp);
+	if (xa_is_err(old)) {
+		kfree(cp);
+		return xa_err(old);
+	}
+	if (old) {
+		comp->cold_bytes -= old->len;
+		kfree(old);
+	} else {
+		comp->cold_pages++;
+	}
+	comp->cold_bytes += len;
+	hot->dirty = false;
+	return 0;
+}
+
+/* Decompress @cp into @page, timing it for the comp_decompress_ns stat */
+static int comp_load(struct simple_comp *comp,
+		     const struct simple_comp_page *cp, struct page *page)
+{
+	void *dst = kmap_local_page(page);
+	u64 start = ktime_get_ns();
+	int ret = PAGE_SIZE;
+
+	if (cp->len == PAGE_SIZE)
+		memcpy(dst, cp->data, PAGE_SIZE);
+	else
+		ret = LZ4_decompress_safe(cp->data, dst, cp->len, PAGE_SIZE);
+	kunmap_local(dst);
+
+	comp->decompress_ns += ktime_get_ns() - start;
+	return ret == PAGE_SIZE ? 0 : -EIO;
+}
+#else
+static int comp_store(struct simple_comp *comp, struct simple_hot_page *hot,
+		      gfp_t gfp)
+{
+	return -EOPNOTSUPP;
+}
+
+static int comp_load(struct simple_comp *comp,
+		     const struct simple_comp_page *cp, struct page *page)
+{
+	return -EOPNOTSUPP;
+}
+#endif
+
+/* Drop @hot from the cache, compressing it first with @gfp if it is dirty */
+static int comp_evict(struct simple_comp *comp, struct simple_hot_page *hot,
+		      gfp_t gfp)
+{
+	if (hot->dirty) {
+		int ret = comp_store(comp, hot, gfp);
+
+		if (ret)
+			return ret;
+	}
+
+	xa_erase(&comp->hot, hot->index);
+	list_del(&hot->lru);
+	comp->nr_hot--;
+	__free_page(hot->page);
+	kfree(hot);
+	return 0;
+}
+
+/*
+ * Find page @index in the hot cache, decompressing it on a miss. Holes
+ * return NULL unless @create is set, in which case a zeroed page is added.
+ * When the cache is over hot_pages, pages are evicted from the least
+ * recently used end until it fits again. Called with comp->lock held.
+ */
+static struct simple_hot_page *comp_get(struct simple_dev *dev, pgoff_t index,
+					bool create, gfp_t gfp)
+{
+	struct simple_comp *comp = &dev->comp;
+	struct simple_hot_page *hot, *victim, *tmp;
+	struct simple_comp_page *cp;
+	int ret;
+
+	hot = xa_load(&comp->hot, index);
+	if (hot) {
+		comp->hits++;
+		list_move(&hot->lru, &comp->lru);
+		return hot;
+	}
+
+	cp = xa_load(&comp->cold, index);
+	if (!cp && !create)
+		return NULL;
+
+	hot = kmalloc_node(sizeof(*hot), gfp, dev->node);
+	if (!hot)
+		return ERR_PTR(-ENOMEM);
+	hot->page = alloc_pages_node(dev->node, gfp | __GFP_ZERO, 0);
+	if (!hot->page) {
+		kfree(hot);
+		return ERR_PTR(-ENOMEM);
+	}
+	hot->index = index;
+	hot->dirty = !cp;
+
+	if (cp) {
+		comp->misses++;
+		ret = comp_load(comp, cp, hot->page);
+		if (ret)
+			goto fail;
+	}
+
+	ret = xa_err(xa_store(&comp->hot, index, hot, gfp));
+	if (ret)
+		goto fail;
+	list_add(&hot->lru, &comp->lru);
+	comp->nr_hot++;
+
+	/*
+	 * A victim that cannot be compressed now stays for a later try, and
+	 * the next older page is evicted instead, so one failure does not
+	 * leave the cache over its size for good.
+	 */
+	list_for_each_entry_safe_reverse(victim, tmp, &comp->lru, lru) {
+		if (comp->nr_hot <= hot_pages || victim == hot)
+			break;
+		if (comp_evict(comp, victim, gfp))
+			comp->evict_failures++;
+	}
+	return hot;
+
+fail:
+	__free_page(hot->page);
+	kfree(hot);
+	return ERR_PTR(ret);
+}
+
+/* Take the store lock, or fail with -EAGAIN for IOCB_NOWAIT */
+static int comp_lock(struct simple_comp *comp, bool nowait)
+{
+	if (!nowait) {
+		mutex_lock(&comp->lock);
+		return 0;
+	}
+	return mutex_trylock(&comp->lock) ? 0 : -EAGAIN;
+}
+
+/* Called for read() in compressed mode */
+static ssize_t comp_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct simple_dev *dev = iocb->ki_filp->private_data;
+	bool nowait = iocb->ki_flags & IOCB_NOWAIT;
+	loff_t size = atomic64_read(&dev->size);
+	size_t count = iov_iter_count(to);
+	loff_t start = iocb->ki_pos;
+	size_t done = 0;
+	ssize_t ret;
+
+	count = start < size ? min_t(loff_t, count, size - start) : 0;
+
+	ret = comp_lock(&dev->comp, nowait);
+	if (ret)
+		goto out;
+	while (done < count) {
+		loff_t cur = start + done;
+		size_t page_offset = offset_in_page(cur);
+		size_t chunk = min_t(size_t, PAGE_SIZE - page_offset,
+				     count - done);
+		struct simple_hot_page *hot;
+		size_t copied;
+
+		hot = comp_get(dev, cur >> PAGE_SHIFT, false,
+			       nowait ? GFP_NOWAIT : GFP_KERNEL);
+		if (IS_ERR(hot)) {
+			ret = PTR_ERR(hot);
+			break;
+		}
+		if (hot)
+			copied = copy_page_to_iter(hot->page, page_offset,
+						   chunk, to);
+		else
+			copied = iov_iter_zero(chunk, to);
+
+		done += copied;
+		if (copied < chunk) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+	mutex_unlock(&dev->comp.lock);
+
+	if (done) {
+		ret = done;
+		iocb->ki_pos += done;
+	} else if (ret == -ENOMEM && nowait) {
+		ret = -EAGAIN;
+	}
+out:
+	simple_io_done(iocb->ki_filp, false, start, count, ret);
+	return ret;
+}
+
+/* Called for write() in compressed mode */
+static ssize_t comp_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct simple_dev *dev = iocb->ki_filp->private_data;
+	bool nowait = iocb->ki_flags & IOCB_NOWAIT;
+	size_t count = iov_iter_count(from);
+	loff_t start = iocb->ki_pos;
+	size_t done = 0;
+	ssize_t ret;
+
+	if (start >= MAX_DEVICE_SIZE) {
+		ret = -ENOSPC;
+		goto out;
+	}
+	count = min_t(loff_t, count, MAX_DEVICE_SIZE - start);
+
+	ret = comp_lock(&dev->comp, nowait);
+	if (ret)
+		goto out;
+	while (done < count) {
+		loff_t cur = start + done;
+		size_t page_offset = offset_in_page(cur);
+		size_t chunk = min_t(size_t, PAGE_SIZE - page_offset,
+				     count - done);
+		struct simple_hot_page *hot;
+		size_t copied;
+
+		hot = comp_get(dev, cur >> PAGE_SHIFT, true,
+			       nowait ? GFP_NOWAIT : GFP_KERNEL);
+		if (IS_ERR(hot)) {
+			ret = PTR_ERR(hot);
+			break;
+		}
+		copied = copy_page_from_iter(hot->page, page_offset, chunk,
+					     from);
+		hot->dirty = true;
+
+		done += copied;
+		if (copied < chunk) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+	mutex_unlock(&dev->comp.lock);
+
+	if (done) {
+		ret = done;
+		simple_grow_size(dev, start + done);
+		iocb->ki_pos += done;
+	} else if (ret == -ENOMEM && nowait) {
+		ret = -EAGAIN;
+	}
+out:
+	simple_io_done(iocb->ki_filp, true, start, count, ret);
+	return ret;
+}
+
+/* Allocate the LZ4 buffers of the compressed store */
+static int comp_init(struct simple_dev *dev)
+{
+	struct simple_comp *comp = &dev->comp;
+
+	comp->wrkmem = vmalloc_node(LZ4_MEM_COMPRESS, dev->node);
+	comp->scratch = kmalloc_node(LZ4_COMPRESSBOUND(PAGE_SIZE), GFP_KERNEL,
+				     dev->node);
+	if (!comp->wrkmem || !comp->scratch)
+		return -ENOMEM;
+	return 0;
+}
+
+/* Free the hot cache and every compressed page */
+static void comp_free(struct simple_dev *dev)
+{
+	struct simple_comp *comp = &dev->comp;
+	struct simple_hot_page *hot, *tmp;
+	struct simple_comp_page *cp;
+	unsigned long index;
+
+	list_for_each_entry_safe(hot, tmp, &comp->lru, lru) {
+		__free_page(hot->page);
+		kfree(hot);
+	}
+	xa_destroy(&comp->hot);
+	xa_for_each(&comp->cold, index, cp)
+		kfree(cp);
+	xa_destroy(&comp->cold);
+	kfree(comp->scratch);
+	vfree(comp->wrkmem);
+}
+
+/* Sum the per-CPU statistics into one snapshot */
+struct simple_stats_total {
+	u64 read_ops;
+	u64 read_bytes;
+	u64 write_ops;
+	u64 write_bytes;
+};
+
+static void simple_stats_read(struct simple_dev *dev,
+			      struct simple_stats_total *total)
+{
+	int cpu;
+
+	memset(total, 0, sizeof(*total));
+	for_each_possible_cpu(cpu) {
+		const struct simple_stats *stats =
+			per_cpu_ptr(dev->stats, cpu);
+		u64 read_ops, read_bytes, write_ops, write_bytes;
+		unsigned int start;
+
+		do {
+			start = u64_stats_fetch_begin(&stats->syncp);
+			read_ops = u64_stats_read(&stats->read_ops);
+			read_bytes = u64_stats_read(&stats->read_bytes);
+			write_ops = u64_stats_read(&stats->write_ops);
+			write_bytes = u64_stats_read(&stats->write_bytes);
+		} while (u64_stats_fetch_retry(&stats->syncp, start));
+
+		total->read_ops += read_ops;
+		total->read_bytes += read_bytes;
+		total->write_ops += write_ops;
+		total->write_bytes += write_bytes;
+	}
+}
+
+/* sysfs attributes under /sys/class/simple/simple_charN/ */
+#define SIMPLE_STAT_ATTR(field)                                            \
+	static ssize_t field##_show(struct device *device,                 \
+				    struct device_attribute *attr, char *buf) \
+	{                                                                  \
+		struct simple_stats_total total;                           \
+									   \
+		simple_stats_read(dev_get_drvdata(device), &total);        \
+		return sysfs_emit(buf, "%llu\n", total.field);             \
+	}                                                                  \
+	static DEVICE_ATTR_RO(field)
+
+SIMPLE_STAT_ATTR(read_ops);
+SIMPLE_STAT_ATTR(read_bytes);
+SIMPLE_STAT_ATTR(write_ops);
+SIMPLE_STAT_ATTR(write_bytes);
+
+/* NUMA node holding the device's memory */
+static ssize_t numa_node_show(struct device *device,
+			      struct device_attribute *attr, char *buf)
+{
+	struct simple_dev *dev = dev_get_drvdata(device);
+
+	return sysfs_emit(buf, "%d\n", dev->node);
+}
+static DEVICE_ATTR_RO(numa_node);
+
+/* Number of 2 MB pages backing the huge page region */
+static ssize_t huge_pages_show(struct device *device,
+			       struct device_attribute *attr, char *buf)
+{
+	struct simple_dev *dev = dev_get_drvdata(device);
+
+	return sysfs_emit(buf, "%lu\n", dev->nr_huge);
+}
+static DEVICE_ATTR_RO(huge_pages);
+
+/* Print @num / @den with two decimals, e.g. "3.41" */
+static ssize_t simple_emit_ratio(char *buf, u64 num, u64 den)
+{
+	u64 hundredths = den ? div64_u64(num * 100, den) : 0;
+
+	return sysfs_emit(buf, "%llu.%02llu\n", div_u64(hundredths, 100),
+			  hundredths % 100);
+}
+
+/* Compressed mode: uncompressed size of the cold pages over their size */
+static ssize_t comp_ratio_show(struct device *device,
+			       struct device_attribute *attr, char *buf)
+{
+	struct simple_dev *dev = dev_get_drvdata(device);
+	struct simple_comp *comp = &dev->comp;
+	u64 pages, bytes;
+
+	mutex_lock(&comp->lock);
+	pages = comp->cold_pages;
+	bytes = comp->cold_bytes;
+	mutex_unlock(&comp->lock);
+
+	return simple_emit_ratio(buf, pages << PAGE_SHIFT, bytes);
+}
+static DEVICE_ATTR_RO(comp_ratio);
+
+/* Compressed mode: percentage of page accesses served by the hot cache */
+static ssize_t comp_hit_rate_show(struct device *device,
+				  struct device_attribute *attr, char *buf)
+{
+	struct simple_dev *dev = dev_get_drvdata(device);
+	struct simple_comp *comp = &dev->comp;
+	u64 hits, misses;
+
+	mutex_lock(&comp->lock);
+	hits = comp->hits;
+	misses = comp->misses;
+	mutex_unlock(&comp->lock);
+
+	return simple_emit_ratio(buf, hits * 100, hits + misses);
+}
+static DEVICE_ATTR_RO(comp_hit_rate);
+
+/* Compressed mode: average time to decompress one page, in ns */
+static ssize_t comp_decompress_ns_show(struct device *device,
+				       struct device_attribute *attr,
+				       char *buf)
+{
+	struct simple_dev *dev = dev_get_drvdata(device);
+	struct simple_comp *comp = &dev->comp;
+	u64 ns, misses;
+
+	mutex_lock(&comp->lock);
+	ns = comp->decompress_ns;
+	misses = comp->misses;
+	mutex_unlock(&comp->lock);
+
+	return sysfs_emit(buf, "%llu\n", misses ? div64_u64(ns, misses) : 0);
+}
+static DEVICE_ATTR_RO(comp_decompress_ns);
+
+/* Compressed mode: evictions that failed to compress a dirty page */
+static ssize_t comp_evict_failures_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct simple_dev *dev = dev_get_drvdata(device);
+	struct simple_comp *comp = &dev->comp;
+	u64 failures;
+
+	mutex_lock(&comp->lock);
+	failures = comp->evict_failures;
+	mutex_unlock(&comp->lock);
+
+	return sysfs_emit(buf, "%llu\n", failures);
+}
+static DEVICE_ATTR_RO(comp_evict_failures);
+
+static struct attribute *simple_attrs[] = {
+	&dev_attr_read_ops.attr,
+	&dev_attr_read_bytes.attr,
+	&dev_attr_write_ops.attr,
+	&dev_attr_write_bytes.attr,
+	&dev_attr_numa_node.attr,
+	&dev_attr_huge_pages.attr,
+	NULL,
+};
+
+static const struct attribute_group simple_group = {
+	.attrs = simple_attrs,
+};
+
+static struct attribute *simple_comp_attrs[] = {
+	&dev_attr_comp_ratio.attr,
+	&dev_attr_comp_hit_rate.attr,
+	&dev_attr_comp_decompress_ns.attr,
+	&dev_attr_comp_evict_failures.attr,
+	NULL,
+};
+
+/* The compressed store statistics only exist in compressed mode */
+static umode_t simple_comp_attr_visible(struct kobject *kobj,
+					struct attribute *attr, int n)
+{
+	return strcmp(mode, "compressed") == 0 ? attr->mode : 0;
+}
+
+static const struct attribute_group simple_comp_group = {
+	.attrs = simple_comp_attrs,
+	.is_visible = simple_comp_attr_visible,
+};
+
+static const struct attribute_group *simple_groups[] = {
+	&simple_group,
+	&simple_comp_group,
+	NULL,
+};
+
+/* Free one device instance and everything it allocated */
+static void simple_dev_free(struct simple_dev *dev)
+{
+	simple_free_pages(dev);
+	vfree(dev->fifo.data);
+	log_free(dev);
+	comp_free(dev);
+	simple_version_put(rcu_dereference_protected(dev->version, true));
+	free_percpu(dev->stats);
+	kfree(dev);
+}
+
+/* Allocate a device instance with its memory on @node */
+static struct simple_dev *simple_dev_alloc(int node)
+{
+	struct simple_dev *dev;
+	int cpu;
+	int i;
+
+	dev = kzalloc_node(sizeof(*dev), GFP_KERNEL, node);
+	if (!dev)
+		return ERR_PTR(-ENOMEM);
+
+	dev->node = node;
+	xa_init(&dev->pages);
+	atomic64_set(&dev->size, 0);
+	atomic_long_set(&dev->nr_pages, 0);
+	for (i = 0; i < ARRAY_SIZE(dev->page_locks); i++)
+		init_rwsem(&dev->page_locks[i]);
+	INIT_LIST_HEAD(&dev->notifiers);
+	mutex_init(&dev->notify_lock);
+	/* The compressed store is empty in other modes, but its stats exist */
+	mutex_init(&dev->comp.lock);
+	xa_init(&dev->comp.cold);
+	xa_init(&dev->comp.hot);
+	INIT_LIST_HEAD(&dev->comp.lru);
+
+	/* Allocate the per-CPU statistics */
+	dev->stats = alloc_percpu(struct simple_stats);
+	if (!dev->stats)
+		goto fail;
+	for_each_possible_cpu(cpu)
+		u64_stats_init(&per_cpu_ptr(dev->stats, cpu)->syncp);
+
+	if (strcmp(mode, "fifo") == 0 && fifo_init(dev))
+		goto fail;
+	if (strcmp(mode, "log") == 0 && log_init(dev))
+		goto fail;
+	if (strcmp(mode, "snapshot") == 0 && snap_init(dev))
+		goto fail;
+	if (strcmp(mode, "compressed") == 0 && comp_init(dev))
+		goto fail;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (huge_size_mb && simple_huge_populate(dev))
+		goto fail;
+#endif
+
+	return dev;
+
+fail:
+	simple_dev_free(dev);
+	return ERR_PTR(-ENOMEM);
+}
+
+/* Pick the NUMA node for device @minor */
+static int simple_dev_node(int minor)
+{
+	static int next = NUMA_NO_NODE;
+
+	if (minor < nr_nodes)
+		return nodes[minor];
+
+	/* Spread the remaining devices round-robin over online nodes */
+	next = next_online_node(next);
+	if (next >= MAX_NUMNODES)
+		next = first_online_node;
+	return next;
+}
+
+/* Create /dev/simple_char@minor */
+static int simple_dev_create(int minor, const struct file_operations *fops)
+{
+	struct simple_dev *dev;
+	dev_t devt = MKDEV(MAJOR(simple_devt), minor);
+	int node = simple_dev_node(minor);
+	int ret;
+
+	if (node < 0 || node >= MAX_NUMNODES || !node_online(node)) {
+		printk(KERN_ALERT "SIMPLE: Node %d is not online\n", node);
+		return -EINVAL;
+	}
+
+	dev = simple_dev_alloc(node);
+	if (IS_ERR(dev))
+		return PTR_ERR(dev);
+
+	/* Initialize and add the character device */
+	cdev_init(&dev->cdev, fops);
+	dev->cdev.owner = THIS_MODULE;
+	ret = cdev_add(&dev->cdev, devt, 1);
+	if (ret < 0) {
+		printk(KERN_ALERT "SIMPLE: Failed to add character device\n");
+		goto fail_cdev_add;
+	}
+
+	/* Create the device, with its statistics attributes */
+	dev->device = device_create_with_groups(simple_class, NULL, devt, dev,
+						simple_groups,
+						DEVICE_NAME "%d", minor);
+	if (IS_ERR(dev->device)) {
+		printk(KERN_ALERT "SIMPLE: Failed to create the device\n");
+		ret = PTR_ERR(dev->device);
+		goto fail_device_create;
+	}
+
+	simple_devs[minor] = dev;
+	printk(KERN_INFO
+	       "SIMPLE: Device created (/dev/%s%d, node %d, %lu huge pages)\n",
+	       DEVICE_NAME, minor, node, dev->nr_huge);
+	return 0;
+
+fail_device_create:
+	cdev_del(&dev->cdev);
+fail_cdev_add:
+	simple_dev_free(dev);
+	return ret;
+}
+
+/* Remove /dev/simple_char@minor and free its memory */
+static void simple_dev_destroy(int minor)
+{
+	struct simple_dev *dev = simple_devs[minor];
+
+	device_destroy(simple_class, MKDEV(MAJOR(simple_devt), minor));
+	cdev_del(&dev->cdev);
+
+	printk(KERN_INFO "SIMPLE: Freeing %ld pages of %s%d\n",
+	       atomic_long_read(&dev->nr_pages), DEVICE_NAME, minor);
+	simple_dev_free(dev);
+	simple_devs[minor] = NULL;
+}
+
+/* Module initialization function */
+static int __init simple_char_init(void)
+{
+	const struct file_operations *fops = &simple_fops;
+	int ret;
+	int i;
+
+	if (!num_devices || num_devices > MAX_DEVICES) {
+		printk(KERN_ALERT "SIMPLE: num_devices must be 1..%d\n",
+		       MAX_DEVICES);
+		return -EINVAL;
+	}
+
+	/* Pick the file operations for the requested mode */
+	if (strcmp(mode, "fifo") == 0) {
+		if (!is_power_of_2(fifo_size) || fifo_size < PAGE_SIZE) {
+			printk(KERN_ALERT
+			       "SIMPLE: fifo_size must be a power of two >= %lu\n",
+			       PAGE_SIZE);
+			return -EINVAL;
+		}
+		fops = &simple_fifo_fops;
+	} else if (strcmp(mode, "log") == 0) {
+		if (log_size < PAGE_SIZE) {
+			printk(KERN_ALERT "SIMPLE: log_size must be >= %lu\n",
+			       PAGE_SIZE);
+			return -EINVAL;
+		}
+		fops = &simple_log_fops;
+	} else if (strcmp(mode, "snapshot") == 0) {
+		fops = &simple_snap_fops;
+	} else if (strcmp(mode, "compressed") == 0) {
+		if (!IS_ENABLED(CONFIG_LZ4_COMPRESS) ||
+		    !IS_ENABLED(CONFIG_LZ4_DECOMPRESS) || !hot_pages) {
+			printk(KERN_ALERT
+			       "SIMPLE: compressed mode needs LZ4 and hot_pages >= 1\n");
+			return -EINVAL;
+		}
+		fops = &simple_comp_fops;
+	} else if (strcmp(mode, "buffer") != 0) {
+		printk(KERN_ALERT "SIMPLE: Unknown mode '%s'\n", mode);
+		return -EINVAL;
+	}
+
+	/* The huge page region is part of the buffer store */
+	if (huge_size_mb && (!IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE) ||
+			     fops != &simple_fops || huge_size_mb > max_size_mb)) {
+		printk(KERN_ALERT
+		       "SIMPLE: huge_size_mb needs buffer mode, THP and <= max_size_mb\n");
+		return -EINVAL;
+	}
+
+	/* Dynamically allocate a major number and a range of minors */
+	ret = alloc_chrdev_region(&simple_devt, 0, num_devices, DEVICE_NAME);
+	if (ret < 0) {
+		printk(KERN_ALERT
+		       "SIMPLE: Failed to register a major number\n");
+		return ret;
+	}
+	printk(KERN_INFO "SIMPLE: Registered with major number %d\n",
+	       MAJOR(simple_devt));
+
+	/* Register the device class - with version-specific API handling */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+	/* New API for Linux 6.12 and later */
+	simple_class = class_create(CLASS_NAME);
+#else
+	/* Legacy API for Linux kernels before 6.12 */
+	simple_class = class_create(THIS_MODULE, CLASS_NAME);
+#endif
+	if (IS_ERR(simple_class)) {
+		printk(KERN_ALERT "SIMPLE: Failed to register device class\n");
+		ret = PTR_ERR(simple_class);
+		goto fail_class_create;
+	}
+	printk(KERN_INFO "SIMPLE: Device class registered\n");
+
+	/* Create each device instance */
+	for (i = 0; i < num_devices; i++) {
+		ret = simple_dev_create(i, fops);
+		if (ret)
+			goto fail_dev_create;
+	}
+
+	printk(KERN_INFO
+	       "SIMPLE: Character device driver initialized (%u devices, %s mode)\n",
+	       num_devices, mode);
+	return 0;
+
+/* Error handling and cleanup */
+fail_dev_create:
+	while (--i >= 0)
+		simple_dev_destroy(i);
+	/* Let freed snapshot versions finish their RCU callbacks */
+	rcu_barrier();
+	class_destroy(simple_class);
+fail_class_create:
+	unregister_chrdev_region(simple_devt, num_devices);
+	return ret;
+}
+
+/* Module cleanup function */
+static void __exit simple_char_exit(void)
+{
+	int i;
+
+	/* Remove every device and free its pages */
+	for (i = 0; i < num_devices; i++)
+		simple_dev_destroy(i);
 
-	/* Remove the device from the system */
-	device_destroy(simple_class, MKDEV(major_number, 0));
+	/* Wait for snapshot versions queued with call_rcu() to be freed */
+	rcu_barrier();
 
 	/* Unregister the device class */
 	class_destroy(simple_class);
 
-	/* Unregister the major number */
-	unregister_chrdev(major_number, DEVICE_NAME);
+	/* Release the device numbers */
+	unregister_chrdev_region(simple_devt, num_devices);
 
 	printk(KERN_INFO "SIMPLE: Character device driver removed\n");
 }
 
 /* Register module init/exit functions */
 module_init(simple_char_init);
-module_exit(simple_char_exit);
\ No newline at end of file
+module_exit(simple_char_exit);
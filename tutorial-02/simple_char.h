@@ -0,0 +1,98 @@
+/*
+ * User-space interface of the simple_char driver, shared by the module
+ * and test_char.c.
+ */
+#ifndef _SIMPLE_CHAR_H
+#define _SIMPLE_CHAR_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Operations of one transfer descriptor */
+#define SIMPLE_CHAR_OP_GET 0 /* Copy from the device to addr */
+#define SIMPLE_CHAR_OP_PUT 1 /* Copy from addr to the device */
+
+/*
+ * One transfer of len bytes between device offset and the user buffer at
+ * addr. The driver fills in result with the number of bytes copied, or a
+ * negative errno, exactly as pread() or pwrite() would have returned.
+ */
+struct simple_char_xfer {
+	__u32 op; /* SIMPLE_CHAR_OP_* */
+	__s32 result; /* Filled in by the driver */
+	__u64 offset; /* Device offset */
+	__u64 addr; /* User buffer */
+	__u32 len; /* Bytes to transfer */
+	__u32 reserved; /* Must be zero */
+};
+
+/*
+ * A batch of nr descriptors at user address xfers, executed in order in
+ * one kernel entry. The batch is 16 bytes, so it fits in the command area
+ * of a regular 64-byte io_uring SQE.
+ */
+struct simple_char_batch {
+	__u64 xfers; /* Array of struct simple_char_xfer */
+	__u32 nr; /* Number of descriptors */
+	__u32 flags; /* Must be zero */
+};
+
+/* Largest nr accepted in one batch */
+#define SIMPLE_CHAR_BATCH_MAX 1024
+
+/* ioctl: execute a struct simple_char_batch, returns descriptors executed */
+#define SIMPLE_CHAR_IOC_BATCH _IOWR('S', 0x01, struct simple_char_batch)
+
+/*
+ * io_uring IORING_OP_URING_CMD command, the batch is carried in sqe->cmd.
+ * Issued inline it may execute fewer than nr descriptors, stopping at the
+ * first that would block; the CQE result says how many ran.
+ */
+#define SIMPLE_CHAR_URING_CMD_BATCH _IOWR('S', 0x80, struct simple_char_batch)
+
+/*
+ * Log mode record, as returned by read() and laid out in mmap(). The
+ * header is followed by len bytes of payload, padded to a multiple of 8.
+ */
+struct simple_char_log_rec {
+	__u64 ts; /* CLOCK_MONOTONIC time of the append, in ns */
+	__u32 cpu; /* CPU whose shard holds the record */
+	__u32 len; /* Payload bytes */
+};
+
+/* Largest payload of one log record, i.e. of one write() */
+#define SIMPLE_CHAR_LOG_MAX_LEN 4096
+
+/* Bytes one record with @len bytes of payload occupies */
+#define SIMPLE_CHAR_LOG_REC_SIZE(len) \
+	(sizeof(struct simple_char_log_rec) + (((len) + 7) & ~7UL))
+
+/* ioctl: empty every shard of the log (needs CAP_SYS_ADMIN) */
+#define SIMPLE_CHAR_IOC_LOG_RESET _IO('S', 0x02)
+
+/*
+ * ioctl: one large GET or PUT described by a struct simple_char_xfer. The
+ * driver pins the user buffer and copies page to page instead of going
+ * through copy_to_user/copy_from_user. Returns the bytes transferred. A
+ * GET writes to user memory, so the command is read/write.
+ */
+#define SIMPLE_CHAR_IOC_DIRECT _IOWR('S', 0x04, struct simple_char_xfer)
+
+/* Largest len accepted by SIMPLE_CHAR_IOC_DIRECT */
+#define SIMPLE_CHAR_DIRECT_MAX (256 << 20)
+
+/*
+ * Change notification: fd is an eventfd signalled after every write to the
+ * device, or -1 to remove the one registered through this file. With a
+ * non-zero coalesce_us, writes less than coalesce_us apart produce at most
+ * one signal per interval.
+ */
+struct simple_char_eventfd {
+	__s32 fd; /* eventfd descriptor, or -1 */
+	__u32 coalesce_us; /* Minimum microseconds between signals */
+};
+
+/* ioctl: register the eventfd in a struct simple_char_eventfd */
+#define SIMPLE_CHAR_IOC_SET_EVENTFD _IOW('S', 0x03, struct simple_char_eventfd)
+
+#endif /* _SIMPLE_CHAR_H */
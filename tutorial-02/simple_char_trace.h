@@ -0,0 +1,94 @@
+/*
+ * Tracepoints for the simple_char driver.
+ *
+ * These replace the per-call printk()s on the data path. When a tracepoint
+ * is disabled it costs a single patched-out branch; enable them with:
+ *
+ *   echo 1 > /sys/kernel/tracing/events/simple_char/enable
+ *   cat /sys/kernel/tracing/trace_pipe
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM simple_char
+
+#if !defined(_SIMPLE_CHAR_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _SIMPLE_CHAR_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* Device opened */
+TRACE_EVENT(simple_char_open,
+	TP_PROTO(unsigned int minor, unsigned int f_flags),
+	TP_ARGS(minor, f_flags),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(unsigned int, f_flags)
+	),
+
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->f_flags = f_flags;
+	),
+
+	TP_printk("minor=%u flags=0x%x", __entry->minor, __entry->f_flags)
+);
+
+/* Device closed */
+TRACE_EVENT(simple_char_release,
+	TP_PROTO(unsigned int minor),
+	TP_ARGS(minor),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+	),
+
+	TP_fast_assign(
+		__entry->minor = minor;
+	),
+
+	TP_printk("minor=%u", __entry->minor)
+);
+
+/* Shared layout for the read and write events */
+DECLARE_EVENT_CLASS(simple_char_io,
+	TP_PROTO(unsigned int minor, loff_t pos, size_t count, ssize_t ret),
+	TP_ARGS(minor, pos, count, ret),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, minor)
+		__field(loff_t, pos)
+		__field(size_t, count)
+		__field(ssize_t, ret)
+	),
+
+	TP_fast_assign(
+		__entry->minor = minor;
+		__entry->pos = pos;
+		__entry->count = count;
+		__entry->ret = ret;
+	),
+
+	TP_printk("minor=%u pos=%lld count=%zu ret=%zd", __entry->minor,
+		  __entry->pos, __entry->count, __entry->ret)
+);
+
+/* Data read from the device */
+DEFINE_EVENT(simple_char_io, simple_char_read,
+	TP_PROTO(unsigned int minor, loff_t pos, size_t count, ssize_t ret),
+	TP_ARGS(minor, pos, count, ret)
+);
+
+/* Data written to the device */
+DEFINE_EVENT(simple_char_io, simple_char_write,
+	TP_PROTO(unsigned int minor, loff_t pos, size_t count, ssize_t ret),
+	TP_ARGS(minor, pos, count, ret)
+);
+
+#endif /* _SIMPLE_CHAR_TRACE_H */
+
+/* This part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE simple_char_trace
+#include <trace/define_trace.h>
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE /* For splice, CPU affinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,10 +6,49 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <signal.h>
 
-#define DEVICE_PATH "/dev/simple_char"
+#include "simple_char.h"
+
+#define DEVICE_PATH "/dev/simple_char0"
+#define SYSFS_PATH "/sys/class/simple/simple_char0"
 #define BUFFER_SIZE 1024
+#define MMAP_TEST_SIZE (64 * 1024)
+#define MMAP_BENCH_SIZE (1024 * 1024)
+#define SPARSE_OFFSET (1024LL * 1024 * 1024) /* 1 GB */
+#define PAGE_BYTES 4096
+#define STRESS_PAGES 4096 /* 16 MB working set */
+#define MAX_THREADS 64
+#define FIFO_TEST_BYTES (64 * 1024 * 1024)
+#define IO_BENCH_BLOCK (64 * 1024)
+#define IO_BENCH_IOVECS 16
+#define MAX_DEVICES 64
+#define MULTI_BENCH_PAGES 4096 /* 16 MB per device */
+#define MULTI_BENCH_BLOCK (64 * 1024)
+#define URING_BENCH_PAGES 4096 /* 16 MB working set */
+#define URING_BENCH_MAX_QD 256
+#define BATCH_BENCH_SIZE (1024 * 1024) /* Region the records are spread over */
+#define BATCH_BENCH_NR 256 /* Descriptors per ioctl */
+#define BENCH_REGION (64 * 1024 * 1024) /* Working set of the bench sweep */
+#define BENCH_MAX_SAMPLES (1 << 20) /* Latency samples kept per thread */
+#define HUGE_BENCH_ACCESSES (16 * 1024 * 1024)
+#define LOG_BENCH_RECORD 64 /* Payload bytes per append */
+#define SNAP_BENCH_SIZE (1024 * 1024) /* Buffer rewritten by each write */
+#define DIRECT_BENCH_MAX (16 * 1024 * 1024) /* Largest direct-bench size */
+#define COMP_BENCH_READS 100000 /* Random 4 KB reads in comp-bench */
+#define WATCH_WRITE_GAP_US 100 /* Pause between the writes of watch */
 
 void display_usage(const char *program_name)
 {
@@ -17,6 +57,21 @@ void display_usage(const char *program_name)
 	printf("  read [offset] [length]   - Read from device (default: offset=0, length=all)\n");
 	printf("  write <data>             - Write data to device\n");
 	printf("  test                     - Run a comprehensive test suite\n");
+	printf("  mmap-bench [iterations]  - Compare mmap() against read() throughput\n");
+	printf("  stress [seconds]         - Multi-threaded reader scaling and torn-write check\n");
+	printf("  fifo                     - Producer/consumer test (load with mode=fifo)\n");
+	printf("  io-bench [MB]            - Compare read, pread, readv and splice throughput\n");
+	printf("  stats                    - Show the per-device I/O counters from sysfs\n");
+	printf("  multi-bench [thr] [s]    - Aggregate throughput vs. device count (num_devices=N)\n");
+	printf("  uring-bench [ops]        - io_uring read vs. uring_cmd ops/s at QD 1..256\n");
+	printf("  batch-bench [records]    - Batched ioctl vs. lseek+read for small records\n");
+	printf("  bench [seconds] [thr]    - Sweep block size, threads and pattern, JSON output\n");
+	printf("  huge-bench [MB]          - Random scan with vs. without huge mappings (huge_size_mb=N)\n");
+	printf("  log-bench [seconds]      - Append scaling and merged-order check (load with mode=log)\n");
+	printf("  snap-bench [seconds]     - Reader latency under 1 MB writes (load with mode=snapshot)\n");
+	printf("  direct-bench [MB]        - copy_*_user vs. pinned-page ioctl at 64 KB, 1 MB, 16 MB\n");
+	printf("  comp-bench [MB]          - Compression ratio, hit rate and read latency (mode=compressed)\n");
+	printf("  watch [coalesce_us] [n]  - Count eventfd and SIGIO notifications for n writes\n");
 	printf("  load                     - Load the module\n");
 	printf("  unload                   - Unload the module\n");
 	printf("  help                     - Display this help message\n");
@@ -193,140 +248,2474 @@ int write_device(const char *data)
 	return 0;
 }
 
-int run_tests()
+/* Monotonic clock in nanoseconds, used by the benchmarks */
+static unsigned long long now_ns(void)
 {
-	int ret;
+	struct timespec ts;
 
-	printf("\n=== Running Character Device Driver Tests ===\n\n");
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-	/* Load the module if not already loaded */
-	ret = system("lsmod | grep simple_char > /dev/null");
-	if (ret != 0) {
-		if (load_module() != 0) {
-			return 1;
+/*
+ * Map the first @size bytes of the device with MAP_SHARED. The device is
+ * sparse and starts out empty, so make sure the logical size covers the
+ * mapping first, otherwise read() would stop short of the mapped data.
+ */
+static char *map_device(int fd, size_t size)
+{
+	char last = 0;
+	char *map;
+
+	if (lseek(fd, 0, SEEK_END) < (off_t)size) {
+		if (pread(fd, &last, 1, size - 1) < 0 ||
+		    pwrite(fd, &last, 1, size - 1) != 1) {
+			fprintf(stderr, "Failed to extend device: %s\n",
+				strerror(errno));
+			return NULL;
 		}
 	}
 
-	/* Test 1: Write a string */
-	printf("Test 1: Writing a string to the device...\n");
-	const char *test_string = "Hello, Character Device Driver!";
-	ret = write_device(test_string);
-	if (ret != 0) {
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Failed to mmap device: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	return map;
+}
+
+/* Check that mmap() and read()/write() see the same buffer */
+int test_mmap()
+{
+	const char *via_write = "WRITTEN THROUGH write()";
+	const char *via_map = "WRITTEN THROUGH mmap()";
+	size_t size = MMAP_TEST_SIZE;
+	char buffer[64];
+	char *map;
+	int fd;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
 		return 1;
 	}
 
-	/* Test 2: Read the string back */
-	printf("\nTest 2: Reading the string back...\n");
-	ret = read_device(0, strlen(test_string));
-	if (ret != 0) {
+	map = map_device(fd, size);
+	if (!map) {
+		close(fd);
 		return 1;
 	}
 
-	/* Test 3: Write to a specific offset */
-	printf("\nTest 3: Writing to offset 10...\n");
-	int fd = open(DEVICE_PATH, O_WRONLY);
+	/* A write() must be visible in the mapping */
+	if (pwrite(fd, via_write, strlen(via_write), 0) < 0 ||
+	    memcmp(map, via_write, strlen(via_write)) != 0) {
+		fprintf(stderr, "write() data not visible through mmap()\n");
+		goto fail;
+	}
+	printf("write() data is visible through the mapping\n");
+
+	/* A store to the mapping must be visible to read() */
+	memcpy(map + 100, via_map, strlen(via_map));
+	if (pread(fd, buffer, strlen(via_map), 100) < 0 ||
+	    memcmp(buffer, via_map, strlen(via_map)) != 0) {
+		fprintf(stderr, "mmap() data not visible through read()\n");
+		goto fail;
+	}
+	printf("mmap() data is visible through read()\n");
+
+	munmap(map, size);
+	close(fd);
+	return 0;
+
+fail:
+	munmap(map, size);
+	close(fd);
+	return 1;
+}
+
+/* Compare copying the whole buffer with read() against the mapping */
+int mmap_benchmark(int iterations)
+{
+	unsigned long long start, read_ns, map_ns;
+	volatile unsigned long sink = 0;
+	size_t size = MMAP_BENCH_SIZE;
+	char *buffer;
+	char *map;
+	int fd;
+
+	fd = open(DEVICE_PATH, O_RDWR);
 	if (fd < 0) {
 		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
 		return 1;
 	}
 
-	if (lseek(fd, 10, SEEK_SET) < 0) {
-		fprintf(stderr, "Failed to seek: %s\n", strerror(errno));
+	map = map_device(fd, size);
+	if (!map) {
 		close(fd);
 		return 1;
 	}
 
-	const char *offset_string = "OFFSET WRITE";
-	ssize_t bytes_written = write(fd, offset_string, strlen(offset_string));
+	buffer = malloc(size);
+	if (!buffer) {
+		munmap(map, size);
+		close(fd);
+		return 1;
+	}
+
+	printf("\n=== mmap() vs read() (%zu byte buffer, %d iterations) ===\n",
+	       size, iterations);
+
+	/* read(): one syscall and one copy_to_user per pass */
+	start = now_ns();
+	for (int i = 0; i < iterations; i++) {
+		if (pread(fd, buffer, size, 0) != (ssize_t)size) {
+			fprintf(stderr, "Short read from device\n");
+			break;
+		}
+		sink += buffer[i % size];
+	}
+	read_ns = now_ns() - start;
+
+	/* mmap(): the data is already in our address space */
+	start = now_ns();
+	for (int i = 0; i < iterations; i++) {
+		const unsigned long *words = (const unsigned long *)map;
+
+		for (size_t j = 0; j < size / sizeof(*words); j++)
+			sink += words[j];
+	}
+	map_ns = now_ns() - start;
+
+	printf("read():  %10.1f MB/s (%.0f ns per pass)\n",
+	       (double)size * iterations * 1000.0 / read_ns,
+	       (double)read_ns / iterations);
+	printf("mmap():  %10.1f MB/s (%.0f ns per pass)\n",
+	       (double)size * iterations * 1000.0 / map_ns,
+	       (double)map_ns / iterations);
+
+	free(buffer);
+	munmap(map, size);
 	close(fd);
+	return 0;
+}
 
-	if (bytes_written < 0) {
-		fprintf(stderr, "Failed to write at offset: %s\n",
-			strerror(errno));
+/* Check that a write far past the end leaves a hole that reads as zeros */
+int test_sparse()
+{
+	const char *tail = "SPARSE TAIL";
+	char buffer[64];
+	off_t end;
+	int fd;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
 		return 1;
 	}
 
-	printf("Successfully wrote %zd bytes at offset 10\n", bytes_written);
+	if (pwrite(fd, tail, strlen(tail), SPARSE_OFFSET) < 0) {
+		fprintf(stderr, "Failed to write at 1 GB: %s\n",
+			strerror(errno));
+		close(fd);
+		return 1;
+	}
 
-	/* Test 4: Read the modified content */
-	printf("\nTest 4: Reading the entire buffer after offset write...\n");
-	ret = read_device(0, 50);
-	if (ret != 0) {
+	/* SEEK_END follows the logical size */
+	end = lseek(fd, 0, SEEK_END);
+	if (end != SPARSE_OFFSET + (off_t)strlen(tail)) {
+		fprintf(stderr, "Unexpected device size %lld\n",
+			(long long)end);
+		close(fd);
 		return 1;
 	}
+	printf("Device size is now %lld bytes\n", (long long)end);
 
-	/* Test 5: Read with an offset */
-	printf("\nTest 5: Reading with offset 10...\n");
-	ret = read_device(10, 20);
-	if (ret != 0) {
+	/* The hole in the middle reads back as zeros */
+	memset(buffer, 0xff, sizeof(buffer));
+	if (pread(fd, buffer, sizeof(buffer), SPARSE_OFFSET / 2) !=
+	    sizeof(buffer)) {
+		fprintf(stderr, "Failed to read hole: %s\n", strerror(errno));
+		close(fd);
 		return 1;
 	}
+	for (size_t i = 0; i < sizeof(buffer); i++) {
+		if (buffer[i] != 0) {
+			fprintf(stderr, "Hole did not read back as zeros\n");
+			close(fd);
+			return 1;
+		}
+	}
+	printf("Hole at 512 MB reads back as zeros\n");
 
-	/* Test 6: Fill the buffer with binary data */
-	printf("\nTest 6: Writing binary data...\n");
-	fd = open(DEVICE_PATH, O_WRONLY);
+	close(fd);
+	return 0;
+}
+
+/* Shared state for the multi-threaded stress test */
+struct stress_thread {
+	pthread_t thread;
+	int id;
+	int fd;
+	volatile int *stop;
+	unsigned long long ops;
+	unsigned long long torn;
+};
+
+/* Reader: pread whole pages at random and check none is torn */
+static void *stress_reader(void *arg)
+{
+	struct stress_thread *t = arg;
+	unsigned int seed = t->id * 7919 + 1;
+	unsigned char page[PAGE_BYTES];
+
+	while (!*t->stop) {
+		off_t off = (off_t)(rand_r(&seed) % STRESS_PAGES) * PAGE_BYTES;
+
+		if (pread(t->fd, page, PAGE_BYTES, off) != PAGE_BYTES)
+			break;
+
+		/* Writers fill whole pages with one byte value */
+		for (int i = 1; i < PAGE_BYTES; i++) {
+			if (page[i] != page[0]) {
+				t->torn++;
+				break;
+			}
+		}
+		t->ops++;
+	}
+
+	return NULL;
+}
+
+/* Writer: overwrite whole random pages with a single byte value */
+static void *stress_writer(void *arg)
+{
+	struct stress_thread *t = arg;
+	unsigned int seed = t->id * 104729 + 1;
+	unsigned char page[PAGE_BYTES];
+
+	while (!*t->stop) {
+		off_t off = (off_t)(rand_r(&seed) % STRESS_PAGES) * PAGE_BYTES;
+
+		memset(page, (t->id << 4) | (t->ops & 0xf), PAGE_BYTES);
+		if (pwrite(t->fd, page, PAGE_BYTES, off) != PAGE_BYTES)
+			break;
+		t->ops++;
+	}
+
+	return NULL;
+}
+
+/*
+ * Run @readers reader threads and @writers writer threads for @seconds.
+ * Returns the aggregate number of reader operations, or -1 on error.
+ */
+static long long stress_run(int readers, int writers, int seconds,
+			    unsigned long long *torn)
+{
+	struct stress_thread threads[MAX_THREADS];
+	volatile int stop = 0;
+	long long reads = 0;
+	int total = readers + writers;
+	int started = 0;
+
+	*torn = 0;
+	for (int i = 0; i < total; i++) {
+		struct stress_thread *t = &threads[i];
+
+		memset(t, 0, sizeof(*t));
+		t->id = i;
+		t->stop = &stop;
+		t->fd = open(DEVICE_PATH, O_RDWR);
+		if (t->fd < 0) {
+			fprintf(stderr, "Failed to open device: %s\n",
+				strerror(errno));
+			break;
+		}
+		if (pthread_create(&t->thread, NULL,
+				   i < readers ? stress_reader : stress_writer,
+				   t) != 0) {
+			close(t->fd);
+			break;
+		}
+		started++;
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i].thread, NULL);
+		close(threads[i].fd);
+		if (i < readers) {
+			reads += threads[i].ops;
+			*torn += threads[i].torn;
+		}
+	}
+
+	return started == total ? reads : -1;
+}
+
+/* Show that readers scale and that concurrent writers never tear a page */
+int stress_test(int seconds)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned long long torn;
+	long long base = 0;
+	char page[PAGE_BYTES];
+	int fd;
+
+	/* Populate the working set with uniform pages */
+	fd = open(DEVICE_PATH, O_RDWR);
 	if (fd < 0) {
 		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
 		return 1;
 	}
+	memset(page, 0, sizeof(page));
+	for (int i = 0; i < STRESS_PAGES; i++) {
+		if (pwrite(fd, page, PAGE_BYTES, (off_t)i * PAGE_BYTES) !=
+		    PAGE_BYTES) {
+			fprintf(stderr, "Failed to populate device: %s\n",
+				strerror(errno));
+			close(fd);
+			return 1;
+		}
+	}
+	close(fd);
 
-	unsigned char binary_data[50];
-	for (int i = 0; i < 50; i++) {
-		binary_data[i] = i;
+	printf("\n=== Reader scaling (%d s per run, %d KB working set) ===\n",
+	       seconds, STRESS_PAGES * PAGE_BYTES / 1024);
+	for (int readers = 1; readers <= cpus && readers <= MAX_THREADS;
+	     readers *= 2) {
+		long long ops = stress_run(readers, 0, seconds, &torn);
+
+		if (ops < 0)
+			return 1;
+		if (!base)
+			base = ops ? ops : 1;
+		printf("%3d readers: %10.1f MB/s  %8.2fx\n", readers,
+		       (double)ops * PAGE_BYTES / seconds / (1024 * 1024),
+		       (double)ops / base);
 	}
 
-	bytes_written = write(fd, binary_data, 50);
-	close(fd);
+	printf("\n=== Torn-write check (4 readers, 4 writers) ===\n");
+	if (stress_run(4, 4, seconds, &torn) < 0)
+		return 1;
+	printf("Torn pages observed: %llu\n", torn);
 
-	if (bytes_written < 0) {
-		fprintf(stderr, "Failed to write binary data: %s\n",
-			strerror(errno));
+	return torn ? 1 : 0;
+}
+
+/* FIFO producer: stream a counting byte pattern into the device */
+static void *fifo_producer(void *arg)
+{
+	unsigned char chunk[8192];
+	size_t sent = 0;
+	int fd = *(int *)arg;
+
+	while (sent < FIFO_TEST_BYTES) {
+		size_t len = sizeof(chunk);
+		ssize_t ret;
+
+		for (size_t i = 0; i < len; i++)
+			chunk[i] = (unsigned char)(sent + i);
+
+		/* Blocking write: sleeps while the ring is full */
+		ret = write(fd, chunk, len);
+		if (ret < 0) {
+			fprintf(stderr, "FIFO write failed: %s\n",
+				strerror(errno));
+			break;
+		}
+		/* The pattern is regenerated from the stream position */
+		sent += ret;
+	}
+
+	return NULL;
+}
+
+/* Check blocking, O_NONBLOCK and epoll behaviour in FIFO mode */
+int fifo_test()
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	unsigned long long start, elapsed;
+	unsigned char buffer[16384];
+	size_t received = 0;
+	pthread_t producer;
+	int rfd, wfd, epfd;
+	int wakeups = 0;
+
+	rfd = open(DEVICE_PATH, O_RDONLY | O_NONBLOCK);
+	wfd = open(DEVICE_PATH, O_WRONLY);
+	if (rfd < 0 || wfd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
 		return 1;
 	}
 
-	printf("Successfully wrote %zd bytes of binary data\n", bytes_written);
+	/* An empty FIFO must not block an O_NONBLOCK reader */
+	if (read(rfd, buffer, sizeof(buffer)) >= 0 || errno != EAGAIN) {
+		fprintf(stderr, "Expected EAGAIN from empty FIFO (is the "
+				"module loaded with mode=fifo?)\n");
+		return 1;
+	}
+	printf("Empty FIFO returns EAGAIN to O_NONBLOCK readers\n");
 
-	/* Test 7: Read the binary data */
-	printf("\nTest 7: Reading binary data...\n");
-	ret = read_device(0, 50);
-	if (ret != 0) {
+	epfd = epoll_create1(0);
+	if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, rfd, &ev) < 0) {
+		fprintf(stderr, "Failed to set up epoll: %s\n",
+			strerror(errno));
 		return 1;
 	}
 
-	printf("\nAll tests completed successfully!\n");
+	start = now_ns();
+	pthread_create(&producer, NULL, fifo_producer, &wfd);
+
+	/* Sleep in epoll until data arrives, then drain what is there */
+	while (received < FIFO_TEST_BYTES) {
+		ssize_t ret;
+
+		if (epoll_wait(epfd, &ev, 1, 5000) <= 0) {
+			fprintf(stderr, "Timed out waiting for data\n");
+			return 1;
+		}
+		wakeups++;
+
+		while ((ret = read(rfd, buffer, sizeof(buffer))) > 0) {
+			for (ssize_t i = 0; i < ret; i++) {
+				if (buffer[i] != (unsigned char)(received + i)) {
+					fprintf(stderr,
+						"Data out of order at byte %zu\n",
+						received + i);
+					return 1;
+				}
+			}
+			received += ret;
+		}
+		if (ret < 0 && errno != EAGAIN) {
+			fprintf(stderr, "FIFO read failed: %s\n",
+				strerror(errno));
+			return 1;
+		}
+	}
+	elapsed = now_ns() - start;
+	pthread_join(producer, NULL);
+
+	printf("Streamed %d MB in order: %.1f MB/s, %d epoll wakeups\n",
+	       FIFO_TEST_BYTES / (1024 * 1024),
+	       (double)received * 1000.0 / elapsed, wakeups);
+
+	close(epfd);
+	close(wfd);
+	close(rfd);
 	return 0;
 }
 
-int main(int argc, char *argv[])
+/* One pass of the I/O benchmark over @size bytes, returns elapsed ns */
+static unsigned long long io_bench_pass(const char *method, int fd,
+					size_t size, char *buffer, int pipefd[2],
+					int nullfd)
 {
-	if (argc < 2) {
-		display_usage(argv[0]);
-		return 1;
+	unsigned long long start = now_ns();
+	struct iovec iov[IO_BENCH_IOVECS];
+	size_t seg = IO_BENCH_BLOCK / IO_BENCH_IOVECS;
+	ssize_t ret = 0;
+
+	for (int i = 0; i < IO_BENCH_IOVECS; i++) {
+		iov[i].iov_base = buffer + i * seg;
+		iov[i].iov_len = seg;
 	}
 
-	if (strcmp(argv[1], "read") == 0) {
-		int offset = 0;
-		int length = 0;
+	lseek(fd, 0, SEEK_SET);
+	for (size_t done = 0; done < size; done += ret) {
+		if (strcmp(method, "read") == 0) {
+			ret = read(fd, buffer, IO_BENCH_BLOCK);
+		} else if (strcmp(method, "pread") == 0) {
+			ret = pread(fd, buffer, IO_BENCH_BLOCK, done);
+		} else if (strcmp(method, "readv") == 0) {
+			/* One syscall moves the whole scatter-gather list */
+			ret = readv(fd, iov, IO_BENCH_IOVECS);
+		} else {
+			/* Device pages go to the pipe by reference */
+			ret = splice(fd, NULL, pipefd[1], NULL, IO_BENCH_BLOCK,
+				     SPLICE_F_MOVE);
+			if (ret > 0 &&
+			    splice(pipefd[0], NULL, nullfd, NULL, ret,
+				   SPLICE_F_MOVE) != ret)
+				ret = -1;
+		}
 
-		if (argc >= 3) {
-			offset = atoi(argv[2]);
+		if (ret <= 0) {
+			fprintf(stderr, "%s failed: %s\n", method,
+				ret < 0 ? strerror(errno) : "unexpected EOF");
+			return 0;
 		}
+	}
 
-		if (argc >= 4) {
-			length = atoi(argv[3]);
+	return now_ns() - start;
+}
+
+/* Compare read(), pread(), readv() and splice() out of the device */
+int io_benchmark(int megabytes)
+{
+	const char *methods[] = { "read", "pread", "readv", "splice" };
+	size_t size = (size_t)megabytes * 1024 * 1024;
+	int fd, nullfd, pipefd[2];
+	char *buffer;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	nullfd = open("/dev/null", O_WRONLY);
+	if (fd < 0 || nullfd < 0 || pipe(pipefd) < 0) {
+		fprintf(stderr, "Failed to set up benchmark: %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	/* Make the pipe large enough for a whole block */
+	fcntl(pipefd[1], F_SETPIPE_SZ, IO_BENCH_BLOCK);
+
+	buffer = malloc(IO_BENCH_BLOCK);
+	if (!buffer)
+		return 1;
+
+	/* Populate the region so every page is backed */
+	memset(buffer, 'x', IO_BENCH_BLOCK);
+	for (size_t off = 0; off < size; off += IO_BENCH_BLOCK) {
+		if (pwrite(fd, buffer, IO_BENCH_BLOCK, off) != IO_BENCH_BLOCK) {
+			fprintf(stderr, "Failed to populate device: %s\n",
+				strerror(errno));
+			return 1;
 		}
+	}
 
-		return read_device(offset, length);
-	} else if (strcmp(argv[1], "write") == 0) {
-		if (argc < 3) {
-			fprintf(stderr, "Error: No data specified for write\n");
-			display_usage(argv[0]);
+	printf("\n=== Read paths over %d MB in %d KB requests ===\n",
+	       megabytes, IO_BENCH_BLOCK / 1024);
+	for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		unsigned long long ns = io_bench_pass(methods[i], fd, size,
+						      buffer, pipefd, nullfd);
+
+		if (!ns)
+			return 1;
+		printf("%-7s %10.1f MB/s\n", methods[i],
+		       (double)size * 1000.0 / ns);
+	}
+
+	free(buffer);
+	close(pipefd[0]);
+	close(pipefd[1]);
+	close(nullfd);
+	close(fd);
+	return 0;
+}
+
+/* Print the I/O counters the driver exports through sysfs */
+int show_stats()
+{
+	const char *counters[] = { "read_ops", "read_bytes", "write_ops",
+				   "write_bytes" };
+
+	printf("\n=== %s ===\n", SYSFS_PATH);
+	for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+		char path[256];
+		unsigned long long value;
+		FILE *fp;
+
+		snprintf(path, sizeof(path), "%s/%s", SYSFS_PATH, counters[i]);
+		fp = fopen(path, "r");
+		if (!fp || fscanf(fp, "%llu", &value) != 1) {
+			fprintf(stderr, "Failed to read %s: %s\n", path,
+				strerror(errno));
+			if (fp)
+				fclose(fp);
 			return 1;
 		}
+		fclose(fp);
+		printf("%-12s %llu\n", counters[i], value);
+	}
 
-		return write_device(argv[2]);
-	} else if (strcmp(argv[1], "test") == 0) {
-		return run_tests();
+	return 0;
+}
+
+/* Read an integer attribute of /dev/simple_char@minor from sysfs */
+static int read_dev_attr(int minor, const char *attr)
+{
+	char path[256];
+	FILE *fp;
+	int value = -1;
+
+	snprintf(path, sizeof(path), "/sys/class/simple/simple_char%d/%s",
+		 minor, attr);
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	if (fscanf(fp, "%d", &value) != 1)
+		value = -1;
+	fclose(fp);
+	return value;
+}
+
+/* Fill @set with the CPUs of NUMA @node; returns the CPU count */
+static int node_cpus(int node, cpu_set_t *set)
+{
+	char path[128];
+	FILE *fp;
+	int lo, hi, count = 0;
+	char sep;
+
+	CPU_ZERO(set);
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+		 node);
+	fp = fopen(path, "r");
+	if (!fp)
+		return 0;
+
+	/* The list looks like "0-3,8-11" */
+	while (fscanf(fp, "%d", &lo) == 1) {
+		hi = lo;
+		sep = fgetc(fp);
+		if (sep == '-') {
+			if (fscanf(fp, "%d", &hi) != 1)
+				break;
+			sep = fgetc(fp);
+		}
+		for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+			CPU_SET(cpu, set);
+			count++;
+		}
+		if (sep != ',')
+			break;
+	}
+
+	fclose(fp);
+	return count;
+}
+
+struct multi_thread {
+	pthread_t thread;
+	int fd;
+	int id;
+	cpu_set_t cpus;
+	volatile int *stop;
+	unsigned long long bytes;
+};
+
+/* Alternate whole-block writes and reads over one device's working set */
+static void *multi_worker(void *arg)
+{
+	struct multi_thread *t = arg;
+	unsigned int seed = t->id * 7919 + 1;
+	const int blocks = MULTI_BENCH_PAGES * PAGE_BYTES / MULTI_BENCH_BLOCK;
+	char *buf = malloc(MULTI_BENCH_BLOCK);
+
+	if (!buf)
+		return NULL;
+	memset(buf, t->id, MULTI_BENCH_BLOCK);
+
+	/* Stay on the device's node so its memory is local */
+	pthread_setaffinity_np(pthread_self(), sizeof(t->cpus), &t->cpus);
+
+	while (!*t->stop) {
+		off_t off = (off_t)(rand_r(&seed) % blocks) * MULTI_BENCH_BLOCK;
+		ssize_t ret;
+
+		if (t->bytes & MULTI_BENCH_BLOCK)
+			ret = pwrite(t->fd, buf, MULTI_BENCH_BLOCK, off);
+		else
+			ret = pread(t->fd, buf, MULTI_BENCH_BLOCK, off);
+		if (ret != MULTI_BENCH_BLOCK)
+			break;
+		t->bytes += ret;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+/*
+ * Run @threads workers on each of the first @ndev devices for @seconds,
+ * pinned to the CPUs of @node_of[i] (or of the device's own node if
+ * @remote is zero). Returns aggregate MB/s, or -1 on error.
+ */
+static double multi_run(int ndev, int threads, int seconds,
+			const int *node_of, int remote, int nnodes)
+{
+	struct multi_thread *t;
+	volatile int stop = 0;
+	unsigned long long bytes = 0;
+	int total = ndev * threads;
+	int started = 0;
+
+	t = calloc(total, sizeof(*t));
+	if (!t)
+		return -1;
+
+	for (int i = 0; i < total; i++) {
+		int minor = i / threads;
+		int node = node_of[minor];
+		char path[64];
+
+		/* The remote run pins each device's workers to the next node */
+		if (remote)
+			node = (node + 1) % nnodes;
+
+		t[i].id = i;
+		t[i].stop = &stop;
+		if (!node_cpus(node, &t[i].cpus))
+			CPU_ZERO(&t[i].cpus);
+		snprintf(path, sizeof(path), "/dev/simple_char%d", minor);
+		t[i].fd = open(path, O_RDWR);
+		if (t[i].fd < 0) {
+			fprintf(stderr, "Failed to open %s: %s\n", path,
+				strerror(errno));
+			break;
+		}
+		if (pthread_create(&t[i].thread, NULL, multi_worker, &t[i])) {
+			close(t[i].fd);
+			break;
+		}
+		started++;
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(t[i].thread, NULL);
+		close(t[i].fd);
+		bytes += t[i].bytes;
+	}
+	free(t);
+
+	if (started != total)
+		return -1;
+	return (double)bytes / seconds / (1024 * 1024);
+}
+
+/*
+ * Show how aggregate throughput scales with the number of device
+ * instances, each driven by threads pinned to its own NUMA node. Load the
+ * module with num_devices=N (and optionally nodes=...) first. NUMA can be
+ * emulated under QEMU with "-numa node,cpus=0-3 -numa node,cpus=4-7".
+ */
+int multi_benchmark(int threads, int seconds)
+{
+	int node_of[MAX_DEVICES];
+	char buf[MULTI_BENCH_BLOCK];
+	int ndev = 0, nnodes = 0;
+	double base = 0;
+
+	/* Find the devices and the node each one lives on */
+	while (ndev < MAX_DEVICES) {
+		char path[64];
+		int fd;
+
+		snprintf(path, sizeof(path), "/dev/simple_char%d", ndev);
+		fd = open(path, O_RDWR);
+		if (fd < 0)
+			break;
+
+		/* Populate the working set so the runs measure copies only */
+		memset(buf, 0, sizeof(buf));
+		for (off_t off = 0; off < (off_t)MULTI_BENCH_PAGES * PAGE_BYTES;
+		     off += sizeof(buf)) {
+			if (pwrite(fd, buf, sizeof(buf), off) != sizeof(buf)) {
+				fprintf(stderr, "Failed to populate %s: %s\n",
+					path, strerror(errno));
+				close(fd);
+				return 1;
+			}
+		}
+		close(fd);
+
+		node_of[ndev] = read_dev_attr(ndev, "numa_node");
+		if (node_of[ndev] < 0)
+			node_of[ndev] = 0;
+		if (node_of[ndev] + 1 > nnodes)
+			nnodes = node_of[ndev] + 1;
+		ndev++;
+	}
+
+	if (!ndev) {
+		fprintf(stderr, "No /dev/simple_charN devices found\n");
+		return 1;
+	}
+
+	printf("\n=== Multi-device scaling (%d threads/device, %d s per run) ===\n",
+	       threads, seconds);
+	for (int i = 0; i < ndev; i++)
+		printf("simple_char%d on node %d\n", i, node_of[i]);
+
+	printf("\n%8s %14s %9s\n", "devices", "local MB/s", "scaling");
+	for (int n = 1; n <= ndev; n++) {
+		double mbs = multi_run(n, threads, seconds, node_of, 0, nnodes);
+
+		if (mbs < 0)
+			return 1;
+		if (!base)
+			base = mbs > 0 ? mbs : 1;
+		printf("%8d %14.1f %8.2fx\n", n, mbs, mbs / base);
+	}
+
+	/* With several nodes, show what cross-node access costs */
+	if (nnodes > 1) {
+		double mbs = multi_run(ndev, threads, seconds, node_of, 1,
+				       nnodes);
+
+		if (mbs < 0)
+			return 1;
+		printf("%8d %14.1f  (remote: workers on the wrong node)\n",
+		       ndev, mbs);
+	}
+
+	return 0;
+}
+
+/* A minimal io_uring, set up with raw syscalls rather than liburing */
+struct uring {
+	int fd;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_len, cq_ring_len, sqes_len;
+};
+
+static int uring_setup(struct uring *r, unsigned int entries)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -1;
+
+	r->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_ring_len = p.cq_off.cqes +
+			 p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	r->sq_ring = mmap(NULL, r->sq_ring_len, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	r->cq_ring = mmap(NULL, r->cq_ring_len, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED ||
+	    r->sqes == MAP_FAILED) {
+		close(r->fd);
+		return -1;
+	}
+
+	r->sq_head = r->sq_ring + p.sq_off.head;
+	r->sq_tail = r->sq_ring + p.sq_off.tail;
+	r->sq_mask = r->sq_ring + p.sq_off.ring_mask;
+	r->sq_array = r->sq_ring + p.sq_off.array;
+	r->cq_head = r->cq_ring + p.cq_off.head;
+	r->cq_tail = r->cq_ring + p.cq_off.tail;
+	r->cq_mask = r->cq_ring + p.cq_off.ring_mask;
+	r->cqes = r->cq_ring + p.cq_off.cqes;
+	return 0;
+}
+
+static void uring_teardown(struct uring *r)
+{
+	munmap(r->sqes, r->sqes_len);
+	munmap(r->cq_ring, r->cq_ring_len);
+	munmap(r->sq_ring, r->sq_ring_len);
+	close(r->fd);
+}
+
+/* Per-request state of the io_uring benchmark */
+struct uring_slot {
+	char buf[PAGE_BYTES];
+	struct simple_char_xfer xfer;
+	off_t offset;
+};
+
+/* Fill the next SQE with a 4 KB read of @slot, as a read or a uring_cmd */
+static void uring_queue(struct uring *r, int fd, int cmd,
+			struct uring_slot *slot, unsigned int id,
+			unsigned int *seed)
+{
+	unsigned int tail = *r->sq_tail;
+	unsigned int index = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[index];
+
+	slot->offset = (off_t)(rand_r(seed) % URING_BENCH_PAGES) * PAGE_BYTES;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->fd = fd;
+	sqe->user_data = id;
+	if (cmd) {
+		struct simple_char_batch batch = {
+			.xfers = (unsigned long)&slot->xfer,
+			.nr = 1,
+		};
+
+		slot->xfer.op = SIMPLE_CHAR_OP_GET;
+		slot->xfer.offset = slot->offset;
+		slot->xfer.addr = (unsigned long)slot->buf;
+		slot->xfer.len = PAGE_BYTES;
+		sqe->opcode = IORING_OP_URING_CMD;
+		sqe->cmd_op = SIMPLE_CHAR_URING_CMD_BATCH;
+		memcpy(sqe->cmd, &batch, sizeof(batch));
+	} else {
+		sqe->opcode = IORING_OP_READ;
+		sqe->addr = (unsigned long)slot->buf;
+		sqe->len = PAGE_BYTES;
+		sqe->off = slot->offset;
+	}
+
+	r->sq_array[index] = index;
+	/* Publish the SQE before the new tail */
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Complete @ops 4 KB random reads keeping @qd requests in flight. Returns
+ * the elapsed time in ns, or 0 on error.
+ */
+static unsigned long long uring_pass(int fd, int cmd, int qd, int ops,
+				     struct uring_slot *slots)
+{
+	unsigned long long start = now_ns();
+	unsigned int seed = qd * 31 + cmd;
+	int submitted = 0, completed = 0, pending = 0;
+	struct uring r;
+
+	if (uring_setup(&r, qd) < 0) {
+		fprintf(stderr, "io_uring_setup failed: %s\n", strerror(errno));
+		return 0;
+	}
+
+	for (int i = 0; i < qd && submitted < ops; i++, submitted++, pending++)
+		uring_queue(&r, fd, cmd, &slots[i], i, &seed);
+
+	while (completed < ops) {
+		unsigned int head, tail;
+
+		/* Submit what is queued and wait for at least one completion */
+		if (syscall(__NR_io_uring_enter, r.fd, pending, 1,
+			    IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "io_uring_enter failed: %s\n",
+				strerror(errno));
+			uring_teardown(&r);
+			return 0;
+		}
+		pending = 0;
+
+		/* Reap completions and reuse their slots for new requests */
+		head = *r.cq_head;
+		tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+			unsigned int id = cqe->user_data;
+			int ok = cmd ? cqe->res == 1 &&
+					       slots[id].xfer.result == PAGE_BYTES
+				     : cqe->res == PAGE_BYTES;
+
+			if (!ok) {
+				fprintf(stderr, "%s request failed: %s\n",
+					cmd ? "uring_cmd" : "read",
+					strerror(cqe->res < 0 ? -cqe->res :
+						 -slots[id].xfer.result));
+				uring_teardown(&r);
+				return 0;
+			}
+			completed++;
+			if (submitted < ops) {
+				uring_queue(&r, fd, cmd, &slots[id], id, &seed);
+				submitted++;
+				pending++;
+			}
+		}
+		__atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	uring_teardown(&r);
+	return now_ns() - start;
+}
+
+/*
+ * Compare IORING_OP_READ (through read_iter with IOCB_NOWAIT) against
+ * IORING_OP_URING_CMD (one-descriptor batches) at increasing queue depth.
+ */
+int uring_benchmark(int ops)
+{
+	struct uring_slot *slots;
+	char page[PAGE_BYTES];
+	int fd;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		return 1;
+	}
+
+	/* Populate the working set so no request hits EOF */
+	memset(page, 'u', sizeof(page));
+	for (int i = 0; i < URING_BENCH_PAGES; i++) {
+		if (pwrite(fd, page, PAGE_BYTES, (off_t)i * PAGE_BYTES) !=
+		    PAGE_BYTES) {
+			fprintf(stderr, "Failed to populate device: %s\n",
+				strerror(errno));
+			close(fd);
+			return 1;
+		}
+	}
+
+	slots = calloc(URING_BENCH_MAX_QD, sizeof(*slots));
+	if (!slots) {
+		close(fd);
+		return 1;
+	}
+
+	printf("\n=== io_uring 4 KB random reads, %d ops per run ===\n", ops);
+	printf("%5s %14s %14s\n", "QD", "read ops/s", "uring_cmd ops/s");
+	for (int qd = 1; qd <= URING_BENCH_MAX_QD; qd *= 2) {
+		unsigned long long read_ns = uring_pass(fd, 0, qd, ops, slots);
+		unsigned long long cmd_ns = uring_pass(fd, 1, qd, ops, slots);
+
+		if (!read_ns || !cmd_ns) {
+			free(slots);
+			close(fd);
+			return 1;
+		}
+		printf("%5d %14.0f %14.0f\n", qd, ops * 1e9 / read_ns,
+		       ops * 1e9 / cmd_ns);
+	}
+
+	free(slots);
+	close(fd);
+	return 0;
+}
+
+/* Run @nr descriptors in one SIMPLE_CHAR_IOC_BATCH call */
+static int batch_ioctl(int fd, struct simple_char_xfer *xfers, unsigned int nr)
+{
+	struct simple_char_batch batch = {
+		.xfers = (unsigned long)xfers,
+		.nr = nr,
+	};
+
+	return ioctl(fd, SIMPLE_CHAR_IOC_BATCH, &batch);
+}
+
+int test_batch()
+{
+	char a[] = "batched record A", b[] = "batched record B";
+	char out_a[sizeof(a)], out_b[sizeof(b)];
+	struct simple_char_xfer xfers[5] = {
+		{ .op = SIMPLE_CHAR_OP_PUT, .offset = 4000, .addr = (unsigned long)a,
+		  .len = sizeof(a) },
+		{ .op = SIMPLE_CHAR_OP_PUT, .offset = 9000, .addr = (unsigned long)b,
+		  .len = sizeof(b) },
+		{ .op = SIMPLE_CHAR_OP_GET, .offset = 9000,
+		  .addr = (unsigned long)out_b, .len = sizeof(out_b) },
+		{ .op = SIMPLE_CHAR_OP_GET, .offset = 4000,
+		  .addr = (unsigned long)out_a, .len = sizeof(out_a) },
+		/* An unknown op fails on its own without stopping the batch */
+		{ .op = 42, .len = 1 },
+	};
+	int fd, ret;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		return 1;
+	}
+
+	ret = batch_ioctl(fd, xfers, 5);
+	close(fd);
+	if (ret != 5) {
+		fprintf(stderr, "Batch ioctl returned %d: %s\n", ret,
+			strerror(errno));
+		return 1;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		if (xfers[i].result != (int)xfers[i].len) {
+			fprintf(stderr, "Descriptor %d returned %d\n", i,
+				xfers[i].result);
+			return 1;
+		}
+	}
+	if (xfers[4].result != -EINVAL) {
+		fprintf(stderr, "Invalid descriptor returned %d\n",
+			xfers[4].result);
+		return 1;
+	}
+	if (memcmp(a, out_a, sizeof(a)) != 0 ||
+	    memcmp(b, out_b, sizeof(b)) != 0) {
+		fprintf(stderr, "Batched data mismatch\n");
+		return 1;
+	}
+
+	printf("Batch of 4 transfers read back correctly, bad op gave EINVAL\n");
+	return 0;
+}
+
+/*
+ * Read @records records of @size bytes at random offsets, either with an
+ * lseek() and read() per record or BATCH_BENCH_NR records per ioctl().
+ * Returns the elapsed time in ns, or 0 on error.
+ */
+static unsigned long long batch_pass(int fd, int batched, int size,
+				     int records, char *buffer,
+				     struct simple_char_xfer *xfers)
+{
+	unsigned long long start = now_ns();
+	unsigned int seed = size;
+	int slots = BATCH_BENCH_SIZE / size;
+
+	for (int done = 0; done < records;) {
+		int n = records - done < BATCH_BENCH_NR ? records - done :
+							  BATCH_BENCH_NR;
+
+		for (int i = 0; i < n; i++) {
+			off_t off = (off_t)(rand_r(&seed) % slots) * size;
+			char *dst = buffer + (size_t)i * size;
+
+			if (batched) {
+				xfers[i].op = SIMPLE_CHAR_OP_GET;
+				xfers[i].offset = off;
+				xfers[i].addr = (unsigned long)dst;
+				xfers[i].len = size;
+			} else if (lseek(fd, off, SEEK_SET) != off ||
+				   read(fd, dst, size) != size) {
+				fprintf(stderr, "lseek+read failed: %s\n",
+					strerror(errno));
+				return 0;
+			}
+		}
+
+		if (batched) {
+			if (batch_ioctl(fd, xfers, n) != n) {
+				fprintf(stderr, "Batch ioctl failed: %s\n",
+					strerror(errno));
+				return 0;
+			}
+			for (int i = 0; i < n; i++) {
+				if (xfers[i].result != size) {
+					fprintf(stderr,
+						"Descriptor returned %d\n",
+						xfers[i].result);
+					return 0;
+				}
+			}
+		}
+		done += n;
+	}
+
+	return now_ns() - start;
+}
+
+/* Compare batched ioctl() transfers against lseek()+read() per record */
+int batch_benchmark(int records)
+{
+	const int sizes[] = { 16, 64, 256 };
+	struct simple_char_xfer xfers[BATCH_BENCH_NR];
+	char *buffer;
+	int fd;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	buffer = malloc(BATCH_BENCH_NR * 256);
+	if (fd < 0 || !buffer) {
+		fprintf(stderr, "Failed to set up benchmark: %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	/* Populate the region so no record hits EOF */
+	memset(buffer, 'b', BATCH_BENCH_NR * 256);
+	for (off_t off = 0; off < BATCH_BENCH_SIZE; off += BATCH_BENCH_NR * 256) {
+		if (pwrite(fd, buffer, BATCH_BENCH_NR * 256, off) !=
+		    BATCH_BENCH_NR * 256) {
+			fprintf(stderr, "Failed to populate device: %s\n",
+				strerror(errno));
+			return 1;
+		}
+	}
+
+	printf("\n=== %d random records, %d per ioctl ===\n", records,
+	       BATCH_BENCH_NR);
+	printf("%6s %16s %16s %9s\n", "size", "lseek+read/s", "batched/s",
+	       "speedup");
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		unsigned long long plain_ns = batch_pass(fd, 0, sizes[i],
+							 records, buffer, xfers);
+		unsigned long long batch_ns = batch_pass(fd, 1, sizes[i],
+							 records, buffer, xfers);
+
+		if (!plain_ns || !batch_ns)
+			return 1;
+		printf("%6d %16.0f %16.0f %8.2fx\n", sizes[i],
+		       records * 1e9 / plain_ns, records * 1e9 / batch_ns,
+		       (double)plain_ns / batch_ns);
+	}
+
+	free(buffer);
+	close(fd);
+	return 0;
+}
+
+/* Access patterns of the bench sweep */
+static const struct {
+	const char *name;
+	int write;
+	int random;
+} bench_patterns[] = {
+	{ "seqread", 0, 0 },
+	{ "randread", 0, 1 },
+	{ "seqwrite", 1, 0 },
+	{ "randwrite", 1, 1 },
+};
+
+struct bench_thread {
+	pthread_t thread;
+	int fd;
+	int id;
+	int threads;
+	int pattern;
+	size_t block;
+	unsigned long long deadline;
+	unsigned long long *lat; /* Per-op latency in ns */
+	size_t ops;
+	int failed;
+};
+
+/*
+ * Issue pread() or pwrite() of one block size until the deadline, timing
+ * every operation. Sequential threads each walk their own slice of the
+ * region; random threads pick block-aligned offsets anywhere in it.
+ */
+static void *bench_worker(void *arg)
+{
+	struct bench_thread *t = arg;
+	size_t blocks = BENCH_REGION / t->block;
+	size_t slice = blocks / t->threads ? blocks / t->threads : 1;
+	size_t next = (t->id * slice) % blocks;
+	unsigned int seed = t->id * 7919 + 1;
+	char *buf;
+
+	buf = malloc(t->block);
+	if (!buf) {
+		t->failed = 1;
+		return NULL;
+	}
+	memset(buf, 'b', t->block);
+
+	while (t->ops < BENCH_MAX_SAMPLES) {
+		unsigned long long start, end;
+		off_t off;
+		ssize_t ret;
+
+		if (bench_patterns[t->pattern].random) {
+			off = (off_t)(rand_r(&seed) % blocks) * t->block;
+		} else {
+			off = (off_t)next * t->block;
+			if (++next % slice == 0 || next >= blocks)
+				next = (t->id * slice) % blocks;
+		}
+
+		start = now_ns();
+		if (bench_patterns[t->pattern].write)
+			ret = pwrite(t->fd, buf, t->block, off);
+		else
+			ret = pread(t->fd, buf, t->block, off);
+		end = now_ns();
+
+		if (ret != (ssize_t)t->block) {
+			t->failed = 1;
+			break;
+		}
+		t->lat[t->ops++] = end - start;
+		if (end >= t->deadline)
+			break;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static int compare_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Value at quantile @q of the sorted samples */
+static unsigned long long percentile(const unsigned long long *sorted,
+				     size_t n, double q)
+{
+	size_t i = (size_t)(q * n);
+
+	return n ? sorted[i < n ? i : n - 1] : 0;
+}
+
+/* Run one point of the sweep and print it as a JSON object */
+static int bench_point(int *fds, int pattern, size_t block, int threads,
+		       int seconds, int first)
+{
+	struct bench_thread t[MAX_THREADS];
+	unsigned long long start, elapsed, *all;
+	size_t total = 0;
+	int ret = 0;
+
+	memset(t, 0, sizeof(t));
+	start = now_ns();
+	for (int i = 0; i < threads; i++) {
+		t[i].fd = fds[i];
+		t[i].id = i;
+		t[i].threads = threads;
+		t[i].pattern = pattern;
+		t[i].block = block;
+		t[i].deadline = start + seconds * 1000000000ULL;
+		t[i].lat = malloc(BENCH_MAX_SAMPLES * sizeof(*t[i].lat));
+		if (!t[i].lat ||
+		    pthread_create(&t[i].thread, NULL, bench_worker, &t[i])) {
+			fprintf(stderr, "Failed to start bench thread\n");
+			for (int j = 0; j < i; j++)
+				pthread_join(t[j].thread, NULL);
+			for (int j = 0; j <= i; j++)
+				free(t[j].lat);
+			return 1;
+		}
+	}
+	for (int i = 0; i < threads; i++) {
+		pthread_join(t[i].thread, NULL);
+		total += t[i].ops;
+		ret |= t[i].failed;
+	}
+	elapsed = now_ns() - start;
+
+	/* Merge every thread's samples for the percentiles */
+	all = malloc((total ? total : 1) * sizeof(*all));
+	if (!all)
+		ret = 1;
+	for (size_t i = 0, n = 0; all && i < (size_t)threads; i++) {
+		memcpy(all + n, t[i].lat, t[i].ops * sizeof(*all));
+		n += t[i].ops;
+	}
+	for (int i = 0; i < threads; i++)
+		free(t[i].lat);
+	if (ret) {
+		fprintf(stderr, "%s failed at bs=%zu threads=%d: %s\n",
+			bench_patterns[pattern].name, block, threads,
+			strerror(errno));
+		free(all);
+		return 1;
+	}
+	qsort(all, total, sizeof(*all), compare_ull);
+
+	printf("%s    {\"pattern\": \"%s\", \"block_size\": %zu, \"threads\": %d, "
+	       "\"ops\": %zu, \"ops_per_sec\": %.0f, \"mb_per_sec\": %.1f, "
+	       "\"lat_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu}}",
+	       first ? "" : ",\n", bench_patterns[pattern].name, block, threads,
+	       total, total * 1e9 / elapsed,
+	       (double)total * block * 1e9 / elapsed / (1024 * 1024),
+	       percentile(all, total, 0.50), percentile(all, total, 0.99),
+	       percentile(all, total, 0.999));
+	fflush(stdout);
+	free(all);
+	return 0;
+}
+
+/*
+ * Sweep block size, thread count and access pattern over the device and
+ * print the results as one JSON document, for tracking regressions. The
+ * device is opened once per thread up front and the same descriptors are
+ * used for every run.
+ */
+int bench(int seconds, int max_threads)
+{
+	const size_t blocks[] = { 512, 4096, 65536, 1024 * 1024 };
+	int fds[MAX_THREADS];
+	char *buf;
+	int first = 1;
+	int ret = 0;
+
+	if (max_threads < 1 || max_threads > MAX_THREADS)
+		max_threads = MAX_THREADS;
+
+	for (int i = 0; i < max_threads; i++) {
+		fds[i] = open(DEVICE_PATH, O_RDWR);
+		if (fds[i] < 0) {
+			fprintf(stderr, "Failed to open device: %s\n",
+				strerror(errno));
+			while (i--)
+				close(fds[i]);
+			return 1;
+		}
+	}
+
+	/* Populate the region so reads never hit EOF or holes */
+	buf = calloc(1, 1024 * 1024);
+	if (!buf)
+		ret = 1;
+	for (off_t off = 0; !ret && off < BENCH_REGION; off += 1024 * 1024) {
+		if (pwrite(fds[0], buf, 1024 * 1024, off) != 1024 * 1024) {
+			fprintf(stderr, "Failed to populate device: %s\n",
+				strerror(errno));
+			ret = 1;
+		}
+	}
+	free(buf);
+
+	if (!ret) {
+		printf("{\n  \"device\": \"%s\",\n  \"seconds_per_run\": %d,\n"
+		       "  \"results\": [\n", DEVICE_PATH, seconds);
+		for (size_t p = 0; !ret && p < sizeof(bench_patterns) /
+						  sizeof(bench_patterns[0]); p++) {
+			for (size_t b = 0; !ret && b < sizeof(blocks) /
+							  sizeof(blocks[0]); b++) {
+				for (int n = 1; !ret && n <= max_threads; n *= 2) {
+					ret = bench_point(fds, p, blocks[b], n,
+							  seconds, first);
+					first = 0;
+				}
+			}
+		}
+		printf("\n  ]\n}\n");
+	}
+
+	for (int i = 0; i < max_threads; i++)
+		close(fds[i]);
+	return ret;
+}
+
+/*
+ * Time random 8-byte loads over a fresh mapping of @size bytes. With
+ * @nohuge set the mapping is marked MADV_NOHUGEPAGE before it is touched,
+ * so every fault installs a 4 KB PTE. Returns ns per access, or -1.
+ */
+static double huge_scan(int fd, size_t size, int nohuge, int accesses)
+{
+	unsigned long long start, ns;
+	unsigned long long x = 88172645463325252ULL;
+	volatile unsigned long sink = 0;
+	size_t words = size / sizeof(unsigned long);
+	unsigned long *map;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Failed to mmap device: %s\n", strerror(errno));
+		return -1;
+	}
+	if (nohuge && madvise(map, size, MADV_NOHUGEPAGE) != 0) {
+		fprintf(stderr, "madvise failed: %s\n", strerror(errno));
+		munmap(map, size);
+		return -1;
+	}
+
+	/* Fault everything in first, so only TLB behaviour is measured */
+	for (size_t i = 0; i < words; i += PAGE_BYTES / sizeof(unsigned long))
+		sink += map[i];
+
+	start = now_ns();
+	for (int i = 0; i < accesses; i++) {
+		/* xorshift64, cheap enough not to hide the TLB misses */
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		sink += map[x % words];
+	}
+	ns = now_ns() - start;
+
+	munmap(map, size);
+	return (double)ns / accesses;
+}
+
+/* Compare random access over huge PMD mappings and over 4 KB PTEs */
+int huge_benchmark(int megabytes)
+{
+	size_t size = (size_t)megabytes * 1024 * 1024;
+	double huge_ns, small_ns;
+	int huge_pages;
+	int fd;
+
+	huge_pages = read_dev_attr(0, "huge_pages");
+	if (huge_pages <= 0)
+		printf("Note: no huge pages, load with huge_size_mb=%d\n",
+		       megabytes);
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		return 1;
+	}
+
+	huge_ns = huge_scan(fd, size, 0, HUGE_BENCH_ACCESSES);
+	small_ns = huge_scan(fd, size, 1, HUGE_BENCH_ACCESSES);
+	close(fd);
+	if (huge_ns < 0 || small_ns < 0)
+		return 1;
+
+	printf("\n=== Random 8-byte loads over %d MB (%d huge pages) ===\n",
+	       megabytes, huge_pages);
+	printf("Huge mappings:   %8.2f ns/access\n", huge_ns);
+	printf("4 KB mappings:   %8.2f ns/access\n", small_ns);
+	printf("Speedup:         %8.2fx\n", small_ns / huge_ns);
+	return 0;
+}
+
+struct log_thread {
+	pthread_t thread;
+	int fd;
+	int cpu;
+	unsigned long long deadline;
+	unsigned long long appends;
+	unsigned long long ns;
+	int failed;
+};
+
+/* Append fixed-size records from one CPU until the deadline or ENOSPC */
+static void *log_appender(void *arg)
+{
+	struct log_thread *t = arg;
+	char record[LOG_BENCH_RECORD];
+	unsigned long long start, now = 0;
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(t->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	memset(record, 'a' + t->cpu % 26, sizeof(record));
+	start = now_ns();
+	do {
+		if (write(t->fd, record, sizeof(record)) != sizeof(record)) {
+			/* A full shard ends the run for this thread */
+			if (errno != ENOSPC)
+				t->failed = 1;
+			break;
+		}
+		t->appends++;
+		if ((t->appends & 255) == 0)
+			now = now_ns();
+	} while (now < t->deadline);
+	t->ns = now_ns() - start;
+
+	return NULL;
+}
+
+/*
+ * Read the whole log back through read() and check that the merged
+ * stream is ordered by timestamp. Returns the record count, or -1.
+ */
+static long long log_check_order(int fd)
+{
+	char *buf = malloc(64 * 1024);
+	unsigned long long last = 0;
+	long long records = 0;
+	ssize_t n;
+
+	if (!buf)
+		return -1;
+
+	while ((n = read(fd, buf, 64 * 1024)) > 0) {
+		for (ssize_t off = 0; off < n;) {
+			struct simple_char_log_rec *rec = (void *)(buf + off);
+
+			if (rec->ts < last) {
+				fprintf(stderr, "Record %lld out of order\n",
+					records);
+				free(buf);
+				return -1;
+			}
+			last = rec->ts;
+			off += SIMPLE_CHAR_LOG_REC_SIZE(rec->len);
+			records++;
+		}
+	}
+
+	free(buf);
+	return n < 0 ? -1 : records;
+}
+
+/*
+ * Show that appends scale with the number of writers, since each CPU
+ * appends to its own shard, then check the merged view is in order.
+ */
+int log_benchmark(int seconds)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	struct log_thread threads[MAX_THREADS];
+	unsigned long long total = 0;
+	double base = 0;
+	long long records;
+	int fd;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		return 1;
+	}
+
+	printf("\n=== Log append scaling (%d-byte records, up to %d s per run) ===\n",
+	       LOG_BENCH_RECORD, seconds);
+	printf("%8s %14s %9s\n", "writers", "appends/s", "scaling");
+	for (int n = 1; n <= cpus && n <= MAX_THREADS; n *= 2) {
+		double rate = 0;
+
+		if (ioctl(fd, SIMPLE_CHAR_IOC_LOG_RESET) != 0) {
+			fprintf(stderr, "Failed to reset log: %s\n",
+				strerror(errno));
+			close(fd);
+			return 1;
+		}
+
+		total = 0;
+		for (int i = 0; i < n; i++) {
+			memset(&threads[i], 0, sizeof(threads[i]));
+			threads[i].fd = fd;
+			threads[i].cpu = i;
+			threads[i].deadline = now_ns() + seconds * 1000000000ULL;
+			pthread_create(&threads[i].thread, NULL, log_appender,
+				       &threads[i]);
+		}
+		for (int i = 0; i < n; i++) {
+			pthread_join(threads[i].thread, NULL);
+			if (threads[i].failed) {
+				fprintf(stderr, "Append failed: %s\n",
+					strerror(errno));
+				close(fd);
+				return 1;
+			}
+			/* Writers may stop early on a full shard */
+			if (threads[i].ns)
+				rate += threads[i].appends * 1e9 / threads[i].ns;
+			total += threads[i].appends;
+		}
+
+		if (!base)
+			base = rate > 0 ? rate : 1;
+		printf("%8d %14.0f %8.2fx\n", n, rate, rate / base);
+	}
+
+	/* A fresh descriptor reads the last run from the start */
+	close(fd);
+	fd = open(DEVICE_PATH, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		return 1;
+	}
+	records = log_check_order(fd);
+	close(fd);
+	if (records < 0 || (unsigned long long)records != total) {
+		fprintf(stderr, "Merged read returned %lld of %llu records\n",
+			records, total);
+		return 1;
+	}
+	printf("\nMerged read: %lld records in timestamp order\n", records);
+
+	return 0;
+}
+
+struct snap_thread {
+	pthread_t thread;
+	int fd;
+	int id;
+	volatile int *stop;
+	unsigned long long *lat;
+	size_t ops;
+	unsigned long long torn;
+	int failed;
+};
+
+/* Rewrite the whole buffer with one byte value per write */
+static void *snap_writer(void *arg)
+{
+	struct snap_thread *t = arg;
+	char *buf = malloc(SNAP_BENCH_SIZE);
+
+	if (!buf) {
+		t->failed = 1;
+		return NULL;
+	}
+	while (!*t->stop) {
+		memset(buf, 'A' + (t->ops + t->id) % 26, SNAP_BENCH_SIZE);
+		if (pwrite(t->fd, buf, SNAP_BENCH_SIZE, 0) != SNAP_BENCH_SIZE) {
+			t->failed = 1;
+			break;
+		}
+		t->ops++;
+	}
+	free(buf);
+	return NULL;
+}
+
+/* Time 4 KB reads from offset 0, each of which takes a new snapshot */
+static void *snap_reader(void *arg)
+{
+	struct snap_thread *t = arg;
+	char buf[PAGE_BYTES];
+
+	while (!*t->stop && t->ops < BENCH_MAX_SAMPLES) {
+		unsigned long long start = now_ns();
+
+		if (pread(t->fd, buf, sizeof(buf), 0) != sizeof(buf)) {
+			t->failed = 1;
+			break;
+		}
+		t->lat[t->ops++] = now_ns() - start;
+	}
+	return NULL;
+}
+
+/* Read the whole buffer and check it comes from a single write */
+static void *snap_checker(void *arg)
+{
+	struct snap_thread *t = arg;
+	char *buf = malloc(SNAP_BENCH_SIZE);
+
+	if (!buf) {
+		t->failed = 1;
+		return NULL;
+	}
+	while (!*t->stop) {
+		/* The read at offset 0 pins one version for the whole copy */
+		if (pread(t->fd, buf, SNAP_BENCH_SIZE, 0) != SNAP_BENCH_SIZE) {
+			t->failed = 1;
+			break;
+		}
+		for (int i = 1; i < SNAP_BENCH_SIZE; i++) {
+			if (buf[i] != buf[0]) {
+				t->torn++;
+				break;
+			}
+		}
+		t->ops++;
+	}
+	free(buf);
+	return NULL;
+}
+
+/*
+ * Measure snapshot read latency alone and with @writers threads doing
+ * 1 MB writes. Prints p50/p99/p999 and returns torn snapshots, or -1.
+ */
+static long long snap_run(int writers, int seconds)
+{
+	struct snap_thread t[MAX_THREADS];
+	volatile int stop = 0;
+	int total = writers + 2; /* Plus the reader and the checker */
+	long long torn = 0;
+	size_t writes = 0;
+	int failed = 0;
+
+	memset(t, 0, sizeof(t));
+	for (int i = 0; i < total; i++) {
+		void *(*fn)(void *) = i == 0 ? snap_reader :
+				      i == 1 ? snap_checker : snap_writer;
+
+		t[i].id = i;
+		t[i].stop = &stop;
+		t[i].fd = open(DEVICE_PATH, O_RDWR);
+		if (i == 0)
+			t[i].lat = malloc(BENCH_MAX_SAMPLES * sizeof(*t[i].lat));
+		if (t[i].fd < 0 || (i == 0 && !t[i].lat) ||
+		    pthread_create(&t[i].thread, NULL, fn, &t[i])) {
+			fprintf(stderr, "Failed to start thread: %s\n",
+				strerror(errno));
+			stop = 1;
+			for (int j = 0; j < i; j++)
+				pthread_join(t[j].thread, NULL);
+			return -1;
+		}
+	}
+
+	sleep(seconds);
+	stop = 1;
+	for (int i = 0; i < total; i++) {
+		pthread_join(t[i].thread, NULL);
+		close(t[i].fd);
+		failed |= t[i].failed;
+		torn += t[i].torn;
+		if (i >= 2)
+			writes += t[i].ops;
+	}
+
+	if (!failed) {
+		qsort(t[0].lat, t[0].ops, sizeof(*t[0].lat), compare_ull);
+		printf("%8d %10zu %10llu %10llu %10llu %12zu\n", writers,
+		       t[0].ops, percentile(t[0].lat, t[0].ops, 0.50),
+		       percentile(t[0].lat, t[0].ops, 0.99),
+		       percentile(t[0].lat, t[0].ops, 0.999), writes);
+	}
+	free(t[0].lat);
+
+	return failed ? -1 : torn;
+}
+
+/* Show that snapshot readers do not slow down behind 1 MB writers */
+int snap_benchmark(int seconds)
+{
+	char *buf = calloc(1, SNAP_BENCH_SIZE);
+	long long torn, total_torn = 0;
+	int fd;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0 || !buf) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		free(buf);
+		return 1;
+	}
+	memset(buf, 'A', SNAP_BENCH_SIZE);
+	if (pwrite(fd, buf, SNAP_BENCH_SIZE, 0) != SNAP_BENCH_SIZE) {
+		fprintf(stderr, "Failed to populate device: %s\n",
+			strerror(errno));
+		close(fd);
+		free(buf);
+		return 1;
+	}
+	close(fd);
+	free(buf);
+
+	printf("\n=== 4 KB snapshot read latency (ns), %d s per run ===\n",
+	       seconds);
+	printf("%8s %10s %10s %10s %10s %12s\n", "writers", "reads", "p50",
+	       "p99", "p999", "1MB writes");
+	for (int writers = 0; writers <= 4; writers = writers ? writers * 2 : 1) {
+		torn = snap_run(writers, seconds);
+		if (torn < 0)
+			return 1;
+		total_torn += torn;
+	}
+
+	printf("\nTorn 1 MB snapshots observed: %lld\n", total_torn);
+	return total_torn ? 1 : 0;
+}
+
+/*
+ * Move @total bytes in transfers of @size, through pread()/pwrite() or
+ * through SIMPLE_CHAR_IOC_DIRECT. Returns MB/s, or a negative value if a
+ * transfer failed.
+ */
+static double direct_pass(int fd, char *buf, size_t size, int write,
+			  int direct, unsigned long long total)
+{
+	unsigned long long iters = total / size ? total / size : 1;
+	unsigned long long start = now_ns();
+
+	for (unsigned long long i = 0; i < iters; i++) {
+		ssize_t ret;
+
+		if (direct) {
+			struct simple_char_xfer xfer = {
+				.op = write ? SIMPLE_CHAR_OP_PUT :
+					      SIMPLE_CHAR_OP_GET,
+				.addr = (uintptr_t)buf,
+				.len = size,
+			};
+
+			ret = ioctl(fd, SIMPLE_CHAR_IOC_DIRECT, &xfer);
+		} else if (write) {
+			ret = pwrite(fd, buf, size, 0);
+		} else {
+			ret = pread(fd, buf, size, 0);
+		}
+		if (ret != (ssize_t)size) {
+			fprintf(stderr, "%s of %zu bytes returned %zd: %s\n",
+				direct ? "SIMPLE_CHAR_IOC_DIRECT" :
+					 write ? "pwrite" : "pread",
+				size, ret, strerror(errno));
+			return -1;
+		}
+	}
+
+	return (double)iters * size / (1024.0 * 1024.0) /
+	       ((now_ns() - start) / 1e9);
+}
+
+/*
+ * Compare copy_*_user (pread/pwrite) against the pinned-page ioctl at
+ * 64 KB, 1 MB and 16 MB, moving @megabytes per measurement.
+ */
+int direct_benchmark(int megabytes)
+{
+	static const size_t sizes[] = { 64 * 1024, 1024 * 1024,
+					DIRECT_BENCH_MAX };
+	unsigned long long total = (unsigned long long)megabytes << 20;
+	char *buf;
+	int fd;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		return 1;
+	}
+	buf = aligned_alloc(PAGE_BYTES, DIRECT_BENCH_MAX);
+	if (!buf) {
+		close(fd);
+		return 1;
+	}
+	/* Fault the buffer in, and populate the device region */
+	memset(buf, 'D', DIRECT_BENCH_MAX);
+	if (pwrite(fd, buf, DIRECT_BENCH_MAX, 0) != DIRECT_BENCH_MAX) {
+		fprintf(stderr, "Failed to populate device: %s\n",
+			strerror(errno));
+		goto fail;
+	}
+
+	/* Check that a direct GET returns what was written */
+	memset(buf, 0, DIRECT_BENCH_MAX);
+	if (direct_pass(fd, buf, DIRECT_BENCH_MAX, 0, 1, 0) < 0)
+		goto fail;
+	for (size_t i = 0; i < DIRECT_BENCH_MAX; i++) {
+		if (buf[i] != 'D') {
+			fprintf(stderr, "Direct read mismatch at %zu\n", i);
+			goto fail;
+		}
+	}
+
+	printf("\n=== Direct transfer throughput (MB/s), %d MB per run ===\n",
+	       megabytes);
+	printf("%10s %6s %12s %12s %8s\n", "size", "op", "copy_user",
+	       "pinned", "speedup");
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (int write = 0; write <= 1; write++) {
+			double copy, pinned;
+
+			copy = direct_pass(fd, buf, sizes[i], write, 0, total);
+			pinned = direct_pass(fd, buf, sizes[i], write, 1, total);
+			if (copy < 0 || pinned < 0)
+				goto fail;
+			printf("%8zuKB %6s %12.0f %12.0f %7.2fx\n",
+			       sizes[i] / 1024, write ? "write" : "read", copy,
+			       pinned, pinned / copy);
+		}
+	}
+
+	free(buf);
+	close(fd);
+	return 0;
+fail:
+	free(buf);
+	close(fd);
+	return 1;
+}
+
+/* Print the compressed-store attributes of device 0 */
+static void comp_show_stats(const char *label)
+{
+	const char *attrs[] = { "comp_ratio", "comp_hit_rate",
+				"comp_decompress_ns", "comp_evict_failures" };
+
+	printf("%-18s", label);
+	for (size_t i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++) {
+		char path[256], value[64] = "?";
+		FILE *fp;
+
+		snprintf(path, sizeof(path), "%s/%s", SYSFS_PATH, attrs[i]);
+		fp = fopen(path, "r");
+		if (fp) {
+			if (!fgets(value, sizeof(value), fp))
+				strcpy(value, "?");
+			value[strcspn(value, "\n")] = '\0';
+			fclose(fp);
+		}
+		printf(" %s=%s", attrs[i], value);
+	}
+	printf("\n");
+}
+
+/*
+ * Fill @megabytes of the device with compressible text, check that it
+ * reads back intact, then time random 4 KB reads, which mostly miss the
+ * hot cache and pay for a decompression.
+ */
+int comp_benchmark(int megabytes)
+{
+	size_t size = (size_t)megabytes << 20;
+	char *buf = malloc(size), *page = malloc(PAGE_BYTES);
+	unsigned long long start, elapsed;
+	int fd, ret = 1;
+
+	if (megabytes <= 0) {
+		fprintf(stderr, "comp-bench needs at least 1 MB\n");
+		goto out_free;
+	}
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0 || !buf || !page) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		goto out;
+	}
+
+	/* Log-like lines: repetitive, but not trivially so */
+	for (size_t off = 0; off < size;) {
+		char line[128];
+		int n = snprintf(line, sizeof(line),
+				 "%012zu INFO request id=%zu status=200 bytes=%zu\n",
+				 off, off / 61, (off * 7919) % 65536);
+
+		if (off + n > size)
+			n = size - off;
+		memcpy(buf + off, line, n);
+		off += n;
+	}
+
+	start = now_ns();
+	if (pwrite(fd, buf, size, 0) != (ssize_t)size) {
+		fprintf(stderr, "Failed to write device: %s\n", strerror(errno));
+		goto out;
+	}
+	elapsed = now_ns() - start;
+	printf("\n=== Compressed store, %d MB ===\n", megabytes);
+	printf("%-18s %.0f MB/s\n", "write", megabytes / (elapsed / 1e9));
+
+	for (size_t off = 0; off < size; off += PAGE_BYTES) {
+		size_t len = size - off < PAGE_BYTES ? size - off : PAGE_BYTES;
+
+		if (pread(fd, page, len, off) != (ssize_t)len ||
+		    memcmp(page, buf + off, len)) {
+			fprintf(stderr, "Data mismatch at offset %zu\n", off);
+			goto out;
+		}
+	}
+	comp_show_stats("after verify");
+
+	srand(1);
+	start = now_ns();
+	for (int i = 0; i < COMP_BENCH_READS; i++) {
+		off_t off = (off_t)(rand() % (size / PAGE_BYTES)) * PAGE_BYTES;
+
+		if (pread(fd, page, PAGE_BYTES, off) != PAGE_BYTES) {
+			fprintf(stderr, "pread failed: %s\n", strerror(errno));
+			goto out;
+		}
+	}
+	elapsed = now_ns() - start;
+	printf("%-18s %.0f ns per 4 KB read\n", "random read",
+	       (double)elapsed / COMP_BENCH_READS);
+	comp_show_stats("after random");
+	ret = 0;
+out:
+	if (fd >= 0)
+		close(fd);
+out_free:
+	free(page);
+	free(buf);
+	return ret;
+}
+
+static volatile sig_atomic_t watch_sigio;
+
+static void watch_sigio_handler(int sig)
+{
+	(void)sig;
+	watch_sigio++;
+}
+
+struct watch_writer {
+	int fd;
+	int writes;
+	volatile int done;
+};
+
+static void *watch_writer(void *arg)
+{
+	struct watch_writer *w = arg;
+
+	for (int i = 0; i < w->writes; i++) {
+		if (pwrite(w->fd, "x", 1, 0) != 1) {
+			perror("pwrite");
+			break;
+		}
+		usleep(WATCH_WRITE_GAP_US);
+	}
+	w->done = 1;
+	return NULL;
+}
+
+/*
+ * Register an eventfd and SIGIO on the device, then count how many
+ * notifications @writes small writes produce. Without coalescing the
+ * eventfd counter must equal the number of writes.
+ */
+int watch_test(int coalesce_us, int writes)
+{
+	struct simple_char_eventfd req;
+	struct watch_writer w = { .writes = writes };
+	struct sigaction sa = { .sa_handler = watch_sigio_handler };
+	unsigned long long wakeups = 0, total = 0, start, elapsed;
+	struct pollfd pfd;
+	uint64_t count;
+	pthread_t thread;
+	int fd, efd;
+	int ret = 0;
+
+	fd = open(DEVICE_PATH, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		return 1;
+	}
+	efd = eventfd(0, EFD_NONBLOCK);
+	if (efd < 0) {
+		perror("eventfd");
+		close(fd);
+		return 1;
+	}
+
+	req.fd = efd;
+	req.coalesce_us = coalesce_us;
+	if (ioctl(fd, SIMPLE_CHAR_IOC_SET_EVENTFD, &req) < 0) {
+		perror("SIMPLE_CHAR_IOC_SET_EVENTFD");
+		ret = 1;
+		goto out;
+	}
+
+	/* Ask for SIGIO on every write as well */
+	sigaction(SIGIO, &sa, NULL);
+	if (fcntl(fd, F_SETOWN, getpid()) < 0 ||
+	    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_ASYNC) < 0) {
+		perror("fcntl(O_ASYNC)");
+		ret = 1;
+		goto out;
+	}
+
+	w.fd = fd;
+	start = now_ns();
+	if (pthread_create(&thread, NULL, watch_writer, &w) != 0) {
+		fprintf(stderr, "Failed to create writer thread\n");
+		ret = 1;
+		goto out;
+	}
+
+	/* Drain the eventfd until the writer is done and it stays quiet */
+	pfd.fd = efd;
+	pfd.events = POLLIN;
+	for (;;) {
+		int n = poll(&pfd, 1, 100);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			if (w.done)
+				break;
+			continue;
+		}
+		if (read(efd, &count, sizeof(count)) == sizeof(count)) {
+			wakeups++;
+			total += count;
+		}
+	}
+	pthread_join(thread, NULL);
+	elapsed = now_ns() - start;
+
+	printf("\n=== Change notification, coalesce %d us ===\n", coalesce_us);
+	printf("%-22s %llu\n", "writes", (unsigned long long)writes);
+	printf("%-22s %llu\n", "eventfd wakeups", wakeups);
+	printf("%-22s %llu\n", "eventfd signals", total);
+	printf("%-22s %llu\n", "SIGIO received", (unsigned long long)watch_sigio);
+	printf("%-22s %.1f ms\n", "elapsed", elapsed / 1e6);
+
+	if (!coalesce_us && total != (unsigned long long)writes) {
+		printf("FAIL: expected %d eventfd signals\n", writes);
+		ret = 1;
+	} else if (coalesce_us) {
+		/* One signal opens each interval, and at most one closes it */
+		unsigned long long limit =
+			2 * (elapsed / (coalesce_us * 1000ULL) + 1);
+
+		if (total > limit) {
+			printf("FAIL: %llu signals exceeds %llu for the interval\n",
+			       total, limit);
+			ret = 1;
+		}
+	}
+
+	req.fd = -1;
+	ioctl(fd, SIMPLE_CHAR_IOC_SET_EVENTFD, &req);
+out:
+	close(efd);
+	close(fd);
+	return ret;
+}
+
+int run_tests()
+{
+	int ret;
+
+	printf("\n=== Running Character Device Driver Tests ===\n\n");
+
+	/* Load the module if not already loaded */
+	ret = system("lsmod | grep simple_char > /dev/null");
+	if (ret != 0) {
+		if (load_module() != 0) {
+			return 1;
+		}
+	}
+
+	/* Test 1: Write a string */
+	printf("Test 1: Writing a string to the device...\n");
+	const char *test_string = "Hello, Character Device Driver!";
+	ret = write_device(test_string);
+	if (ret != 0) {
+		return 1;
+	}
+
+	/* Test 2: Read the string back */
+	printf("\nTest 2: Reading the string back...\n");
+	ret = read_device(0, strlen(test_string));
+	if (ret != 0) {
+		return 1;
+	}
+
+	/* Test 3: Write to a specific offset */
+	printf("\nTest 3: Writing to offset 10...\n");
+	int fd = open(DEVICE_PATH, O_WRONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		return 1;
+	}
+
+	if (lseek(fd, 10, SEEK_SET) < 0) {
+		fprintf(stderr, "Failed to seek: %s\n", strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	const char *offset_string = "OFFSET WRITE";
+	ssize_t bytes_written = write(fd, offset_string, strlen(offset_string));
+	close(fd);
+
+	if (bytes_written < 0) {
+		fprintf(stderr, "Failed to write at offset: %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	printf("Successfully wrote %zd bytes at offset 10\n", bytes_written);
+
+	/* Test 4: Read the modified content */
+	printf("\nTest 4: Reading the entire buffer after offset write...\n");
+	ret = read_device(0, 50);
+	if (ret != 0) {
+		return 1;
+	}
+
+	/* Test 5: Read with an offset */
+	printf("\nTest 5: Reading with offset 10...\n");
+	ret = read_device(10, 20);
+	if (ret != 0) {
+		return 1;
+	}
+
+	/* Test 6: Fill the buffer with binary data */
+	printf("\nTest 6: Writing binary data...\n");
+	fd = open(DEVICE_PATH, O_WRONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
+		return 1;
+	}
+
+	unsigned char binary_data[50];
+	for (int i = 0; i < 50; i++) {
+		binary_data[i] = i;
+	}
+
+	bytes_written = write(fd, binary_data, 50);
+	close(fd);
+
+	if (bytes_written < 0) {
+		fprintf(stderr, "Failed to write binary data: %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	printf("Successfully wrote %zd bytes of binary data\n", bytes_written);
+
+	/* Test 7: Read the binary data */
+	printf("\nTest 7: Reading binary data...\n");
+	ret = read_device(0, 50);
+	if (ret != 0) {
+		return 1;
+	}
+
+	/* Test 8: Share the buffer through mmap() */
+	printf("\nTest 8: Accessing the buffer through mmap()...\n");
+	ret = test_mmap();
+	if (ret != 0) {
+		return 1;
+	}
+
+	/* Test 9: Grow the device sparsely */
+	printf("\nTest 9: Writing at 1 GB to create a hole...\n");
+	ret = test_sparse();
+	if (ret != 0) {
+		return 1;
+	}
+
+	/* Test 10: Many small transfers in one ioctl */
+	printf("\nTest 10: Batched transfers through ioctl()...\n");
+	ret = test_batch();
+	if (ret != 0) {
+		return 1;
+	}
+
+	printf("\nAll tests completed successfully!\n");
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		display_usage(argv[0]);
+		return 1;
+	}
+
+	if (strcmp(argv[1], "read") == 0) {
+		int offset = 0;
+		int length = 0;
+
+		if (argc >= 3) {
+			offset = atoi(argv[2]);
+		}
+
+		if (argc >= 4) {
+			length = atoi(argv[3]);
+		}
+
+		return read_device(offset, length);
+	} else if (strcmp(argv[1], "write") == 0) {
+		if (argc < 3) {
+			fprintf(stderr, "Error: No data specified for write\n");
+			display_usage(argv[0]);
+			return 1;
+		}
+
+		return write_device(argv[2]);
+	} else if (strcmp(argv[1], "test") == 0) {
+		return run_tests();
+	} else if (strcmp(argv[1], "mmap-bench") == 0) {
+		int iterations = 10000;
+
+		if (argc >= 3) {
+			iterations = atoi(argv[2]);
+		}
+
+		return mmap_benchmark(iterations);
+	} else if (strcmp(argv[1], "stress") == 0) {
+		int seconds = 2;
+
+		if (argc >= 3) {
+			seconds = atoi(argv[2]);
+		}
+
+		return stress_test(seconds);
+	} else if (strcmp(argv[1], "fifo") == 0) {
+		return fifo_test();
+	} else if (strcmp(argv[1], "io-bench") == 0) {
+		int megabytes = 64;
+
+		if (argc >= 3) {
+			megabytes = atoi(argv[2]);
+		}
+
+		return io_benchmark(megabytes);
+	} else if (strcmp(argv[1], "stats") == 0) {
+		return show_stats();
+	} else if (strcmp(argv[1], "multi-bench") == 0) {
+		int threads = 2;
+		int seconds = 2;
+
+		if (argc >= 3) {
+			threads = atoi(argv[2]);
+		}
+
+		if (argc >= 4) {
+			seconds = atoi(argv[3]);
+		}
+
+		return multi_benchmark(threads, seconds);
+	} else if (strcmp(argv[1], "uring-bench") == 0) {
+		int ops = 200000;
+
+		if (argc >= 3) {
+			ops = atoi(argv[2]);
+		}
+
+		return uring_benchmark(ops);
+	} else if (strcmp(argv[1], "batch-bench") == 0) {
+		int records = 100000;
+
+		if (argc >= 3) {
+			records = atoi(argv[2]);
+		}
+
+		return batch_benchmark(records);
+	} else if (strcmp(argv[1], "bench") == 0) {
+		int seconds = 1;
+		int threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+		if (argc >= 3) {
+			seconds = atoi(argv[2]);
+		}
+
+		if (argc >= 4) {
+			threads = atoi(argv[3]);
+		}
+
+		return bench(seconds, threads);
+	} else if (strcmp(argv[1], "huge-bench") == 0) {
+		int megabytes = 1024;
+
+		if (argc >= 3) {
+			megabytes = atoi(argv[2]);
+		}
+
+		return huge_benchmark(megabytes);
+	} else if (strcmp(argv[1], "log-bench") == 0) {
+		int seconds = 1;
+
+		if (argc >= 3) {
+			seconds = atoi(argv[2]);
+		}
+
+		return log_benchmark(seconds);
+	} else if (strcmp(argv[1], "snap-bench") == 0) {
+		int seconds = 2;
+
+		if (argc >= 3) {
+			seconds = atoi(argv[2]);
+		}
+
+		return snap_benchmark(seconds);
+	} else if (strcmp(argv[1], "direct-bench") == 0) {
+		int megabytes = 1024;
+
+		if (argc >= 3) {
+			megabytes = atoi(argv[2]);
+		}
+
+		return direct_benchmark(megabytes);
+	} else if (strcmp(argv[1], "comp-bench") == 0) {
+		int megabytes = 64;
+
+		if (argc >= 3) {
+			megabytes = atoi(argv[2]);
+		}
+
+		return comp_benchmark(megabytes);
+	} else if (strcmp(argv[1], "watch") == 0) {
+		int coalesce_us = 0;
+		int writes = 1000;
+
+		if (argc >= 3) {
+			coalesce_us = atoi(argv[2]);
+		}
+
+		if (argc >= 4) {
+			writes = atoi(argv[3]);
+		}
+
+		return watch_test(coalesce_us, writes);
 	} else if (strcmp(argv[1], "load") == 0) {
 		return load_module();
 	} else if (strcmp(argv[1], "unload") == 0) {
@@ -8,11 +8,95 @@
 #include <linux/vmalloc.h> /* For vmalloc, vfree */
 #include <linux/mm.h> /* For get_free_pages */
 #include <linux/uaccess.h> /* For copy_to_user, copy_from_user */
+#include <linux/mutex.h> /* For the benchmark lock */
+#include <linux/sort.h> /* For sorting latency samples */
+#include <linux/timekeeping.h> /* For ktime_get_ns */
+#include <linux/string.h> /* For strsep, strim */
+#include <linux/kthread.h> /* For the per-CPU benchmark threads */
+#include <linux/llist.h> /* For cross-CPU hand-off */
+#include <linux/cpumask.h> /* For cpulist_parse */
+#include <linux/completion.h> /* For waiting on benchmark threads */
+#include <linux/wait.h> /* For the benchmark start signal */
+#include <linux/mempool.h> /* For the pool's emergency reserve */
+#include <linux/percpu.h> /* For the per-CPU magazines */
+#include <linux/nodemask.h> /* For walking NUMA nodes */
+#include <linux/topology.h> /* For cpumask_of_node, node_distance */
+#include <linux/random.h> /* For shuffling the pointer chase */
+#include <linux/vmstat.h> /* For compaction and reclaim stall counts */
+#include <linux/shrinker.h> /* For giving cached objects back under pressure */
+#include <linux/smp.h> /* For on_each_cpu */
+#include <linux/version.h> /* For LINUX_VERSION_CODE */
+
+#include "kmem_stats.h"
 
 #define PROCFS_NAME "kmem_demo"
+#define STATS_PROC_NAME "kmem_demo_stats"
 #define KMALLOC_SIZE (4 * 1024) /* 4 KB */
 #define VMALLOC_SIZE (8 * 1024 * 1024) /* 8 MB */
 #define PAGE_ORDER 2 /* 2^2 = 4 pages */
+#define CMD_MAX 128 /* Longest command accepted by /proc/kmem_demo */
+
+/* Largest order the page allocator hands out (MAX_ORDER was exclusive before 6.4) */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+#define KMEM_MAX_ORDER MAX_PAGE_ORDER
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+#define KMEM_MAX_ORDER MAX_ORDER
+#else
+#define KMEM_MAX_ORDER (MAX_ORDER - 1)
+#endif
+
+/* Allocator benchmark: alloc/free pairs per configuration, size sweep */
+#define BENCH_ITERATIONS 1000
+#define BENCH_MAX_ITERATIONS 1000000
+#define BENCH_MIN_SHIFT 3 /* 8 B */
+#define BENCH_MAX_SHIFT 22 /* 4 MB */
+#define BENCH_NR_SIZES (BENCH_MAX_SHIFT - BENCH_MIN_SHIFT + 1)
+#define BENCH_BIG_SIZE (64 * 1024) /* Above this, run fewer iterations */
+#define BENCH_MIN_RUNS 16
+#define BENCH_CACHE_MAX (8 * PAGE_SIZE) /* Largest kmem_cache object tried */
+
+/* demo_struct pool */
+#define POOL_MAG_SIZE 32 /* Objects per magazine */
+#define POOL_DEPOT_MAGS 64 /* Spare magazines in the depot */
+#define POOL_RESERVE 64 /* Objects kept back for GFP_ATOMIC */
+#define RESERVE_TEST_MAX 4096 /* Most allocations one "reserve" test holds */
+
+/* demo_struct inventory */
+#define OBJECTS_MAX (16 * 1024 * 1024) /* Largest count "objects" accepts */
+
+/* Scalability benchmark */
+#define SCALE_MS 200 /* Default run time per point */
+#define SCALE_MAX_MS 10000
+#define SCALE_MAX_STEPS 16 /* Thread counts 1, 2, 4, ... */
+#define SCALE_BATCH 64 /* Operations between clock checks */
+#define SCALE_KMALLOC_SIZE 256
+#define SCALE_VMALLOC_SIZE (4 * PAGE_SIZE)
+
+/* Access-cost measurement */
+#define REGION_CHASE_BATCH 1024 /* Loads between clock checks */
+#define REGION_STREAM_CHUNK (64 * 1024) /* Bytes between clock checks */
+
+/* NUMA access benchmark */
+#define NUMA_MB 64 /* Default buffer size, well past the LLC */
+#define NUMA_MAX_MB 1024
+#define NUMA_MS 200 /* Default run time per measurement */
+#define NUMA_MAX_RESULTS 64 /* Every CPU node x memory node pair, up to 8x8 */
+
+/* vmalloc mapping benchmark */
+#define TLB_MS 200 /* Default run time per measurement */
+
+/* Fragmentation stress */
+#define FRAG_SECONDS 10 /* Default run time */
+#define FRAG_MAX_SECONDS 600
+#define FRAG_PIN_MB 256 /* Default memory pinned to fragment */
+#define FRAG_MAX_PIN_MB 65536
+#define FRAG_HOLD 4 /* Blocks of each order kept allocated at once */
+#define FRAG_HIST_BUCKETS 8 /* <1us, <4us, ... <4ms, >=4ms */
+
+/* vmalloc_huge() and VM_ALLOW_HUGE_VMAP arrived in 5.18 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+#define KMEM_HAVE_VMALLOC_HUGE 1
+#endif
 
 /* Module metadata */
 MODULE_LICENSE("GPL");
@@ -20,12 +104,30 @@ MODULE_AUTHOR("Utsav Balar");
 MODULE_DESCRIPTION("Kernel memory management demonstration module");
 MODULE_VERSION("0.1");
 
+/* NUMA node the demo allocations come from */
+static int alloc_node = NUMA_NO_NODE;
+module_param(alloc_node, int, 0444);
+MODULE_PARM_DESC(alloc_node,
+		 "NUMA node for the demo allocations (default: -1, the local node)");
+
+/* Map the 8 MB vmalloc region with huge pages where the architecture can */
+static bool vmalloc_huge_map;
+module_param(vmalloc_huge_map, bool, 0444);
+MODULE_PARM_DESC(vmalloc_huge_map,
+		 "Allocate the vmalloc region with vmalloc_huge() (default: N)");
+
 /* Memory pointers for different allocation types */
 static void *kmalloc_ptr = NULL;
 static void *vmalloc_ptr = NULL;
 static unsigned long page_ptr = 0;
 static struct kmem_cache *cache = NULL;
 static void *cache_ptr = NULL;
+static struct demo_pool *obj_pool = NULL;
+
+/* Shared stats page, mapped read-only through /proc/kmem_demo_stats */
+static struct page *stats_page;
+static struct kmem_stats_page *stats;
+static DEFINE_SPINLOCK(stats_publish_lock); /* Serializes publishers */
 
 /* Structure for kmem_cache example */
 struct demo_struct {
@@ -34,11 +136,622 @@ struct demo_struct {
 	struct list_head list;
 };
 
+/*
+ * Inventory of demo_struct objects created by the "objects" command and
+ * listed after the summary in /proc/kmem_demo. demo_objects_gen changes
+ * whenever the list does, so a reader can tell if its cursor is stale.
+ */
+static LIST_HEAD(demo_objects);
+static unsigned long demo_nr_objects;
+static u64 demo_objects_gen;
+static int demo_next_id = 2; /* 1 is cache_ptr */
+static DEFINE_MUTEX(objects_mutex); /* Protects the inventory */
+
+/*
+ * Recompute the bytes held by each allocator and store them in the stats
+ * page. Called from process context after every change to the pointers
+ * above or to the object inventory; stats_publish_lock keeps the procfs
+ * commands from interleaving their updates. A reader of the mapping can
+ * only see the totals once seq is even again, so total_bytes always
+ * matches the per-allocator fields next to it.
+ */
+static void kmem_stats_publish(void)
+{
+	u64 kmalloc_bytes = kmalloc_ptr ? KMALLOC_SIZE : 0;
+	u64 vmalloc_bytes = vmalloc_ptr ? VMALLOC_SIZE : 0;
+	u64 page_bytes = page_ptr ? PAGE_SIZE << PAGE_ORDER : 0;
+	u64 cache_objects = (cache_ptr ? 1 : 0) + READ_ONCE(demo_nr_objects);
+
+	spin_lock(&stats_publish_lock);
+	WRITE_ONCE(stats->seq, stats->seq + 1);
+	smp_wmb();
+
+	WRITE_ONCE(stats->kmalloc_bytes, kmalloc_bytes);
+	WRITE_ONCE(stats->vmalloc_bytes, vmalloc_bytes);
+	WRITE_ONCE(stats->page_bytes, page_bytes);
+	WRITE_ONCE(stats->cache_objects, cache_objects);
+	WRITE_ONCE(stats->cache_object_size, sizeof(struct demo_struct));
+	WRITE_ONCE(stats->total_bytes,
+		   kmalloc_bytes + vmalloc_bytes + page_bytes +
+			   cache_objects * sizeof(struct demo_struct));
+	WRITE_ONCE(stats->updates, stats->updates + 1);
+
+	smp_wmb();
+	WRITE_ONCE(stats->seq, stats->seq + 1);
+	spin_unlock(&stats_publish_lock);
+}
+
+/*
+ * mmap() of /proc/kmem_demo_stats: exactly one page at offset 0, read-only
+ * for good. test_kmem polls it in a tight loop instead of reading and
+ * parsing /proc/kmem_demo.
+ */
+static int kmem_stats_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	/* Without VM_MAYWRITE, mprotect(PROT_WRITE) fails too */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+	/* vm_insert_page() takes its own reference; see kmem_demo_exit() */
+	return vm_insert_page(vma, vma->vm_start, stats_page);
+}
+
+static const struct proc_ops kmem_stats_fops = {
+	.proc_mmap = kmem_stats_mmap,
+};
+
+/*
+ * demo_struct object pool
+ *
+ * A magazine allocator layered on demo_cache. Each CPU has one loaded
+ * magazine, a small array of free objects, and allocates and frees
+ * through it with interrupts disabled and no shared cache lines. When the
+ * magazine runs empty (or full), the CPU swaps it for a full (or empty)
+ * one from the depot, a spinlock-protected list shared by all CPUs, so
+ * objects freed on one CPU are reused on another without going back to
+ * the slab. Only when the depot cannot help does the pool refill or drain
+ * half a magazine at once through kmem_cache_alloc_bulk() and
+ * kmem_cache_free_bulk(). kmem_cache_alloc_bulk() must be called with
+ * interrupts enabled, so a caller that has them disabled (a hardirq
+ * handler, or code under spin_lock_irqsave()) refills with a single
+ * kmem_cache_alloc() instead.
+ *
+ * A mempool of POOL_RESERVE objects backs the pool: if the slab cannot
+ * satisfy a GFP_ATOMIC refill, the allocation is served from the reserve,
+ * and frees top the reserve up again before anything else. The "reserve"
+ * command exercises this path.
+ *
+ * Objects sitting in magazines are idle memory, so the pool registers a
+ * shrinker. Under reclaim it frees the depot's magazines back to the slab,
+ * first pushing every CPU's loaded magazine into the depot if the depot
+ * holds nothing. The pool then refills lazily on the next allocations.
+ * The mempool reserve is never shrunk.
+ */
+struct pool_mag {
+	struct list_head list; /* On depot_full or depot_empty */
+	unsigned int count;
+	void *objs[POOL_MAG_SIZE];
+};
+
+struct pool_cpu {
+	struct pool_mag *loaded;
+	u64 hits; /* Served by the loaded magazine */
+	u64 swaps; /* Magazines exchanged with the depot */
+	u64 refills; /* Bulk refills from the slab */
+	u64 drains; /* Bulk frees to the slab */
+	u64 reserve; /* Served by the mempool reserve */
+};
+
+/* Outcome of the last "reserve" command */
+struct pool_reserve_test {
+	unsigned int allocs; /* GFP_ATOMIC allocations attempted */
+	unsigned int from_slab;
+	unsigned int from_reserve;
+	unsigned int failed;
+	int reserve_after; /* Reserve level once everything was freed */
+};
+
+struct demo_pool {
+	struct kmem_cache *cache;
+	struct pool_cpu __percpu *cpus;
+	spinlock_t depot_lock;
+	struct list_head depot_full; /* Magazines holding objects */
+	struct list_head depot_empty; /* Empty magazines */
+	unsigned int depot_nr_full;
+	unsigned long depot_nr_objs; /* Objects in depot_full */
+	mempool_t *reserve;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+	struct shrinker *shrinker;
+#else
+	struct shrinker shrinker;
+	bool shrinker_registered;
+#endif
+	atomic_long_t shrink_scans; /* scan_objects calls */
+	atomic_long_t shrink_freed; /* Objects they gave back */
+	struct pool_reserve_test last_test; /* Of the "reserve" command */
+};
+
+static struct demo_pool *shrinker_to_pool(struct shrinker *shrink)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+	return shrink->private_data;
+#else
+	return container_of(shrink, struct demo_pool, shrinker);
+#endif
+}
+
+/* Free every object in @mag back to the slab */
+static void pool_mag_empty(struct demo_pool *pool, struct pool_mag *mag)
+{
+	if (mag->count)
+		kmem_cache_free_bulk(pool->cache, mag->count, mag->objs);
+	mag->count = 0;
+}
+
+static void demo_pool_destroy(struct demo_pool *pool)
+{
+	struct pool_mag *mag, *tmp;
+	int cpu;
+
+	if (!pool)
+		return;
+
+	/* Stop reclaim from scanning the pool before tearing it down */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+	shrinker_free(pool->shrinker);
+#else
+	if (pool->shrinker_registered)
+		unregister_shrinker(&pool->shrinker);
+#endif
+
+	if (pool->cpus) {
+		for_each_possible_cpu(cpu) {
+			mag = per_cpu_ptr(pool->cpus, cpu)->loaded;
+			if (!mag)
+				continue;
+			pool_mag_empty(pool, mag);
+			kfree(mag);
+		}
+		free_percpu(pool->cpus);
+	}
+	list_splice_init(&pool->depot_full, &pool->depot_empty);
+	list_for_each_entry_safe(mag, tmp, &pool->depot_empty, list) {
+		pool_mag_empty(pool, mag);
+		kfree(mag);
+	}
+	mempool_destroy(pool->reserve);
+	kfree(pool);
+}
+
+/*
+ * Exchange the loaded magazine of @pc for one from the depot: a full one
+ * if @want_full, else an empty one. Called with interrupts disabled.
+ */
+static bool pool_depot_swap(struct demo_pool *pool, struct pool_cpu *pc,
+			    bool want_full)
+{
+	struct list_head *take = want_full ? &pool->depot_full :
+					     &pool->depot_empty;
+	struct list_head *give = want_full ? &pool->depot_empty :
+					     &pool->depot_full;
+	struct pool_mag *mag;
+
+	spin_lock(&pool->depot_lock);
+	mag = list_first_entry_or_null(take, struct pool_mag, list);
+	if (mag) {
+		list_del(&mag->list);
+		list_add(&pc->loaded->list, give);
+		if (want_full) {
+			pool->depot_nr_full--;
+			pool->depot_nr_objs -= mag->count;
+		} else {
+			pool->depot_nr_full++;
+			pool->depot_nr_objs += pc->loaded->count;
+		}
+		pc->loaded = mag;
+		pc->swaps++;
+	}
+	spin_unlock(&pool->depot_lock);
+	return mag;
+}
+
+/* Objects cached in the depot and in every CPU's loaded magazine */
+static unsigned long demo_pool_count(struct shrinker *shrink,
+				     struct shrink_control *sc)
+{
+	struct demo_pool *pool = shrinker_to_pool(shrink);
+	unsigned long count = READ_ONCE(pool->depot_nr_objs);
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += READ_ONCE(per_cpu_ptr(pool->cpus, cpu)->loaded->count);
+	return count ? count : SHRINK_EMPTY;
+}
+
+/* IPI handler: move this CPU's loaded magazine into the depot */
+static void pool_flush_cpu(void *info)
+{
+	struct demo_pool *pool = info;
+	struct pool_cpu *pc = this_cpu_ptr(pool->cpus);
+
+	if (pc->loaded->count)
+		pool_depot_swap(pool, pc, false);
+}
+
+/* Free whole depot magazines until at least @nr objects are gone */
+static unsigned long pool_depot_free(struct demo_pool *pool, unsigned long nr)
+{
+	unsigned long flags, freed = 0;
+	struct pool_mag *mag;
+
+	while (freed < nr) {
+		spin_lock_irqsave(&pool->depot_lock, flags);
+		mag = list_first_entry_or_null(&pool->depot_full,
+					       struct pool_mag, list);
+		if (mag) {
+			list_del(&mag->list);
+			pool->depot_nr_full--;
+			pool->depot_nr_objs -= mag->count;
+		}
+		spin_unlock_irqrestore(&pool->depot_lock, flags);
+		if (!mag)
+			break;
+
+		/* Free outside the lock, then recycle the empty magazine */
+		freed += mag->count;
+		pool_mag_empty(pool, mag);
+		spin_lock_irqsave(&pool->depot_lock, flags);
+		list_add(&mag->list, &pool->depot_empty);
+		spin_unlock_irqrestore(&pool->depot_lock, flags);
+	}
+	return freed;
+}
+
+static unsigned long demo_pool_scan(struct shrinker *shrink,
+				    struct shrink_control *sc)
+{
+	struct demo_pool *pool = shrinker_to_pool(shrink);
+	unsigned long freed;
+
+	/* Per-CPU magazines are only reachable from their own CPU */
+	if (!READ_ONCE(pool->depot_nr_full))
+		on_each_cpu(pool_flush_cpu, pool, 1);
+
+	freed = pool_depot_free(pool, sc->nr_to_scan);
+	atomic_long_inc(&pool->shrink_scans);
+	atomic_long_add(freed, &pool->shrink_freed);
+	return freed ? freed : SHRINK_STOP;
+}
+
+/* shrinker_alloc() replaced the embedded struct shrinker in 6.7 */
+static int demo_pool_register_shrinker(struct demo_pool *pool)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0)
+	pool->shrinker = shrinker_alloc(0, "kmem_demo-pool");
+	if (!pool->shrinker)
+		return -ENOMEM;
+	pool->shrinker->count_objects = demo_pool_count;
+	pool->shrinker->scan_objects = demo_pool_scan;
+	pool->shrinker->private_data = pool;
+	shrinker_register(pool->shrinker);
+#else
+	int ret;
+
+	pool->shrinker.count_objects = demo_pool_count;
+	pool->shrinker.scan_objects = demo_pool_scan;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 0, 0)
+	ret = register_shrinker(&pool->shrinker, "kmem_demo-pool");
+#else
+	ret = register_shrinker(&pool->shrinker);
+#endif
+	if (ret)
+		return ret;
+	pool->shrinker_registered = true;
+#endif
+	return 0;
+}
+
+/* Create a pool over @cache with a loaded magazine per possible CPU */
+static struct demo_pool *demo_pool_create(struct kmem_cache *cache)
+{
+	struct demo_pool *pool;
+	struct pool_mag *mag;
+	int cpu, i;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+	pool->cache = cache;
+	spin_lock_init(&pool->depot_lock);
+	INIT_LIST_HEAD(&pool->depot_full);
+	INIT_LIST_HEAD(&pool->depot_empty);
+
+	pool->cpus = alloc_percpu(struct pool_cpu);
+	if (!pool->cpus)
+		goto fail;
+	for_each_possible_cpu(cpu) {
+		mag = kzalloc_node(sizeof(*mag), GFP_KERNEL, cpu_to_node(cpu));
+		if (!mag)
+			goto fail;
+		per_cpu_ptr(pool->cpus, cpu)->loaded = mag;
+	}
+	for (i = 0; i < POOL_DEPOT_MAGS; i++) {
+		mag = kzalloc(sizeof(*mag), GFP_KERNEL);
+		if (!mag)
+			goto fail;
+		list_add(&mag->list, &pool->depot_empty);
+	}
+
+	pool->reserve = mempool_create_slab_pool(POOL_RESERVE, cache);
+	if (!pool->reserve)
+		goto fail;
+
+	if (demo_pool_register_shrinker(pool))
+		goto fail;
+	return pool;
+
+fail:
+	demo_pool_destroy(pool);
+	return NULL;
+}
+
+/*
+ * Allocate one object; may sleep only if @gfp allows it. Callable with
+ * interrupts disabled as long as @gfp does not allow sleeping.
+ */
+static void *demo_pool_alloc(struct demo_pool *pool, gfp_t gfp)
+{
+	void *objs[POOL_MAG_SIZE / 2];
+	struct pool_cpu *pc;
+	unsigned long flags;
+	void *obj = NULL;
+	int n, i;
+
+	local_irq_save(flags);
+	pc = this_cpu_ptr(pool->cpus);
+	if (pc->loaded->count || pool_depot_swap(pool, pc, true)) {
+		obj = pc->loaded->objs[--pc->loaded->count];
+		pc->hits++;
+	}
+	local_irq_restore(flags);
+	if (obj)
+		return obj;
+
+	/* The bulk refill would re-enable interrupts under our caller */
+	if (irqs_disabled()) {
+		obj = kmem_cache_alloc(pool->cache, gfp | __GFP_NOWARN);
+		if (obj)
+			return obj;
+		goto reserve;
+	}
+
+	/* Refill half a magazine in one call */
+	n = kmem_cache_alloc_bulk(pool->cache, gfp | __GFP_NOWARN,
+				  ARRAY_SIZE(objs), objs);
+	if (!n)
+		goto reserve;
+
+	/* We may have moved CPUs; stock whichever magazine is loaded now */
+	local_irq_save(flags);
+	pc = this_cpu_ptr(pool->cpus);
+	pc->refills++;
+	for (i = 1; i < n && pc->loaded->count < POOL_MAG_SIZE; i++)
+		pc->loaded->objs[pc->loaded->count++] = objs[i];
+	local_irq_restore(flags);
+
+	if (i < n)
+		kmem_cache_free_bulk(pool->cache, n - i, objs + i);
+	return objs[0];
+
+reserve:
+	obj = mempool_alloc(pool->reserve, gfp);
+	if (obj)
+		this_cpu_inc(pool->cpus->reserve);
+	return obj;
+}
+
+/* Return @obj to the pool; callable from any context */
+static void demo_pool_free(struct demo_pool *pool, void *obj)
+{
+	struct pool_cpu *pc;
+	struct pool_mag *mag;
+	unsigned long flags;
+
+	/* Keep the emergency reserve full before caching anything */
+	if (READ_ONCE(pool->reserve->curr_nr) < pool->reserve->min_nr) {
+		mempool_free(obj, pool->reserve);
+		return;
+	}
+
+	local_irq_save(flags);
+	pc = this_cpu_ptr(pool->cpus);
+	if (pc->loaded->count == POOL_MAG_SIZE &&
+	    !pool_depot_swap(pool, pc, false)) {
+		/* Depot out of empty magazines: give half back to the slab */
+		mag = pc->loaded;
+		mag->count -= POOL_MAG_SIZE / 2;
+		kmem_cache_free_bulk(pool->cache, POOL_MAG_SIZE / 2,
+				     mag->objs + mag->count);
+		pc->drains++;
+	}
+	pc->loaded->objs[pc->loaded->count++] = obj;
+	local_irq_restore(flags);
+}
+
+/*
+ * Reserve test: give every cached object back to the slab, then make
+ * @n GFP_ATOMIC allocations with interrupts disabled, as a hardirq
+ * handler would, and hold them all. Each one misses the magazines, so it
+ * comes from the slab or, if the slab fails, from the mempool reserve;
+ * the drop in the reserve level tells the two apart. Run it with
+ * failslab enabled for demo_cache to see the reserve take over.
+ */
+static int demo_pool_reserve_test(struct demo_pool *pool, unsigned int n)
+{
+	struct pool_reserve_test res = { .allocs = n };
+	unsigned long flags;
+	unsigned int i, got = 0;
+	int level;
+	void **objs;
+
+	objs = kvmalloc_array(n, sizeof(*objs), GFP_KERNEL);
+	if (!objs)
+		return -ENOMEM;
+
+	on_each_cpu(pool_flush_cpu, pool, 1);
+	pool_depot_free(pool, ULONG_MAX);
+
+	level = READ_ONCE(pool->reserve->curr_nr);
+	for (i = 0; i < n; i++) {
+		local_irq_save(flags);
+		objs[got] = demo_pool_alloc(pool, GFP_ATOMIC);
+		local_irq_restore(flags);
+		if (objs[got])
+			got++;
+		else
+			res.failed++;
+	}
+	res.from_reserve = max(level - READ_ONCE(pool->reserve->curr_nr), 0);
+	res.from_slab = got - min(got, res.from_reserve);
+
+	/* The reserve is topped up first as they are freed */
+	for (i = 0; i < got; i++)
+		demo_pool_free(pool, objs[i]);
+	res.reserve_after = READ_ONCE(pool->reserve->curr_nr);
+	kvfree(objs);
+
+	pool->last_test = res;
+	return 0;
+}
+
+/* Print the pool's per-CPU counters summed over all CPUs */
+static void demo_pool_show(struct seq_file *m, struct demo_pool *pool)
+{
+	u64 hits = 0, swaps = 0, refills = 0, drains = 0, reserve = 0;
+	unsigned int cached = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct pool_cpu *pc = per_cpu_ptr(pool->cpus, cpu);
+
+		hits += READ_ONCE(pc->hits);
+		swaps += READ_ONCE(pc->swaps);
+		refills += READ_ONCE(pc->refills);
+		drains += READ_ONCE(pc->drains);
+		reserve += READ_ONCE(pc->reserve);
+		cached += READ_ONCE(pc->loaded->count);
+	}
+
+	seq_printf(m, "   Pool: %u objects per magazine, %u magazines with %lu objects in depot, %u cached per-CPU\n",
+		   POOL_MAG_SIZE, READ_ONCE(pool->depot_nr_full),
+		   READ_ONCE(pool->depot_nr_objs), cached);
+	seq_printf(m, "   Pool: %llu hits, %llu depot swaps, %llu bulk refills, %llu bulk drains\n",
+		   hits, swaps, refills, drains);
+	seq_printf(m, "   Pool: reserve %d/%d, %llu allocations served from it\n",
+		   READ_ONCE(pool->reserve->curr_nr), pool->reserve->min_nr,
+		   reserve);
+	seq_printf(m, "   Pool: shrinker freed %ld objects in %ld scans\n",
+		   atomic_long_read(&pool->shrink_freed),
+		   atomic_long_read(&pool->shrink_scans));
+	if (pool->last_test.allocs)
+		seq_printf(m, "   Pool: reserve test: %u GFP_ATOMIC allocations with IRQs off, %u from the slab, %u from the reserve, %u failed; reserve %d/%d after freeing\n",
+			   pool->last_test.allocs, pool->last_test.from_slab,
+			   pool->last_test.from_reserve,
+			   pool->last_test.failed,
+			   pool->last_test.reserve_after,
+			   pool->reserve->min_nr);
+}
+
+/*
+ * vmalloc @size bytes on @node, asking for huge mappings if @huge. There
+ * is no node-targeted vmalloc_huge(), so huge mappings come from the local
+ * node.
+ */
+static void *kmem_vmalloc(unsigned long size, bool huge, int node)
+{
+#ifdef KMEM_HAVE_VMALLOC_HUGE
+	if (huge)
+		return vmalloc_huge(size, GFP_KERNEL);
+#endif
+	return vmalloc_node(size, node);
+}
+
+/* NUMA node backing @addr, which may be a vmalloc address */
+static int kmem_addr_node(const void *addr)
+{
+	if (is_vmalloc_addr(addr))
+		return page_to_nid(vmalloc_to_page(addr));
+	return page_to_nid(virt_to_page(addr));
+}
+
+/*
+ * Grow or shrink the inventory to @count objects, allocating from the
+ * pool and freeing from the tail. Stops early on a fatal signal.
+ */
+static int demo_objects_resize(unsigned long count)
+{
+	struct demo_struct *obj;
+	int ret = 0;
+
+	mutex_lock(&objects_mutex);
+	while (demo_nr_objects < count) {
+		obj = demo_pool_alloc(obj_pool, GFP_KERNEL);
+		if (!obj) {
+			ret = -ENOMEM;
+			break;
+		}
+		obj->id = demo_next_id++;
+		snprintf(obj->name, sizeof(obj->name), "object-%d", obj->id);
+		list_add_tail(&obj->list, &demo_objects);
+		WRITE_ONCE(demo_nr_objects, demo_nr_objects + 1);
+		demo_objects_gen++;
+		if (!(demo_nr_objects % 1024)) {
+			if (fatal_signal_pending(current)) {
+				ret = -EINTR;
+				break;
+			}
+			cond_resched();
+		}
+	}
+	while (demo_nr_objects > count) {
+		obj = list_last_entry(&demo_objects, struct demo_struct, list);
+		list_del(&obj->list);
+		demo_pool_free(obj_pool, obj);
+		WRITE_ONCE(demo_nr_objects, demo_nr_objects - 1);
+		demo_objects_gen++;
+		if (!(demo_nr_objects % 1024))
+			cond_resched();
+	}
+	mutex_unlock(&objects_mutex);
+
+	kmem_stats_publish();
+	return ret;
+}
+
 /* Initialize memory allocations */
 static int __init init_memory(void)
 {
+	struct page *pages;
+
+	/* NUMA_NO_NODE lets every allocator pick the local node */
+	if (alloc_node != NUMA_NO_NODE &&
+	    (alloc_node < 0 || alloc_node >= nr_node_ids ||
+	     !node_state(alloc_node, N_MEMORY))) {
+		pr_err("kmem_demo: Node %d has no memory\n", alloc_node);
+		return -EINVAL;
+	}
+
 	/* 1. kmalloc example - 4KB with GFP_KERNEL */
-	kmalloc_ptr = kmalloc(KMALLOC_SIZE, GFP_KERNEL);
+	kmalloc_ptr = kmalloc_node(KMALLOC_SIZE, GFP_KERNEL, alloc_node);
 	if (!kmalloc_ptr) {
 		pr_err("kmem_demo: Failed to allocate kmalloc memory\n");
 		goto fail_kmalloc;
@@ -48,7 +761,7 @@ static int __init init_memory(void)
 		KMALLOC_SIZE, kmalloc_ptr);
 
 	/* 2. vmalloc example - 8MB */
-	vmalloc_ptr = vmalloc(VMALLOC_SIZE);
+	vmalloc_ptr = kmem_vmalloc(VMALLOC_SIZE, vmalloc_huge_map, alloc_node);
 	if (!vmalloc_ptr) {
 		pr_err("kmem_demo: Failed to allocate vmalloc memory\n");
 		goto fail_vmalloc;
@@ -58,11 +771,12 @@ static int __init init_memory(void)
 		VMALLOC_SIZE, vmalloc_ptr);
 
 	/* 3. get_free_pages example - 4 pages = 16KB on systems with 4KB pages */
-	page_ptr = __get_free_pages(GFP_KERNEL, PAGE_ORDER);
-	if (!page_ptr) {
+	pages = alloc_pages_node(alloc_node, GFP_KERNEL, PAGE_ORDER);
+	if (!pages) {
 		pr_err("kmem_demo: Failed to allocate pages\n");
 		goto fail_pages;
 	}
+	page_ptr = (unsigned long)page_address(pages);
 	memset((void *)page_ptr, 0, PAGE_SIZE << PAGE_ORDER);
 	pr_info("kmem_demo: Allocated %lu bytes with get_free_pages at address 0x%lx\n",
 		PAGE_SIZE << PAGE_ORDER, page_ptr);
@@ -76,7 +790,7 @@ static int __init init_memory(void)
 	}
 
 	/* Allocate an object from the cache */
-	cache_ptr = kmem_cache_alloc(cache, GFP_KERNEL);
+	cache_ptr = kmem_cache_alloc_node(cache, GFP_KERNEL, alloc_node);
 	if (!cache_ptr) {
 		pr_err("kmem_demo: Failed to allocate from kmem_cache\n");
 		goto fail_cache_alloc;
@@ -90,9 +804,18 @@ static int __init init_memory(void)
 	pr_info("kmem_demo: Allocated object of size %lu bytes from kmem_cache at address 0x%px\n",
 		sizeof(struct demo_struct), cache_ptr);
 
+	/* 5. Per-CPU magazine pool on top of the cache */
+	obj_pool = demo_pool_create(cache);
+	if (!obj_pool) {
+		pr_err("kmem_demo: Failed to create the demo_struct pool\n");
+		goto fail_pool;
+	}
+
 	return 0;
 
 /* Error handling and cleanup */
+fail_pool:
+	kmem_cache_free(cache, cache_ptr);
 fail_cache_alloc:
 	kmem_cache_destroy(cache);
 fail_cache_create:
@@ -109,6 +832,10 @@ fail_kmalloc:
 static void free_memory(void)
 {
 	/* Free all allocated memory in reverse order of allocation */
+	if (obj_pool)
+		demo_objects_resize(0);
+	demo_pool_destroy(obj_pool);
+
 	if (cache_ptr)
 		kmem_cache_free(cache, cache_ptr);
 
@@ -124,12 +851,1453 @@ static void free_memory(void)
 	if (kmalloc_ptr)
 		kfree(kmalloc_ptr);
 
+	obj_pool = NULL;
+	cache_ptr = NULL;
+	cache = NULL;
+	page_ptr = 0;
+	vmalloc_ptr = NULL;
+	kmalloc_ptr = NULL;
+	kmem_stats_publish();
+
 	pr_info("kmem_demo: All memory freed\n");
 }
 
+/*
+ * Allocator microbenchmark
+ *
+ * "bench [iterations]" written to /proc/kmem_demo times alloc/free pairs
+ * for every allocator, every GFP flag set and every power-of-two size from
+ * 8 B to 4 MB. Combinations an allocator does not support (vmalloc without
+ * GFP_KERNEL, kmalloc above KMALLOC_MAX_SIZE, ...) are skipped. The results
+ * stay in bench_results until the next run and are shown in /proc/kmem_demo.
+ */
+enum bench_alloc {
+	BENCH_KMALLOC,
+	BENCH_VMALLOC,
+	BENCH_PAGES,
+	BENCH_CACHE,
+	NR_BENCH_ALLOCS,
+};
+
+static const char *const bench_alloc_names[NR_BENCH_ALLOCS] = {
+	[BENCH_KMALLOC] = "kmalloc",
+	[BENCH_VMALLOC] = "vmalloc",
+	[BENCH_PAGES] = "alloc_pages",
+	[BENCH_CACHE] = "kmem_cache",
+};
+
+static const struct {
+	const char *name;
+	gfp_t gfp;
+} bench_gfps[] = {
+	{ "GFP_KERNEL", GFP_KERNEL },
+	{ "GFP_NOWAIT", GFP_NOWAIT },
+	{ "GFP_ATOMIC", GFP_ATOMIC },
+};
+
+struct bench_result {
+	u8 alloc; /* enum bench_alloc */
+	u8 gfp; /* Index into bench_gfps */
+	u32 size;
+	u32 ops; /* alloc/free pairs timed */
+	u32 failures; /* Allocations that returned NULL */
+	u64 mean_ns;
+	u64 p99_ns;
+};
+
+static struct bench_result
+	bench_results[NR_BENCH_ALLOCS * ARRAY_SIZE(bench_gfps) * BENCH_NR_SIZES];
+static unsigned int bench_nr_results;
+/*
+ * Serializes runs and readers of results. A run can hold it for minutes,
+ * so /proc/kmem_demo readers only ever mutex_trylock() it. Commands that
+ * also hold off CPU hotplug take bench_mutex first and cpus_read_lock()
+ * inside it, directly or through helpers such as all_vm_events(); never
+ * the other way round.
+ */
+static DEFINE_MUTEX(bench_mutex);
+
+static int bench_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Whether @alloc can serve @size bytes with @gfp */
+static bool bench_supported(enum bench_alloc alloc, gfp_t gfp, size_t size)
+{
+	switch (alloc) {
+	case BENCH_KMALLOC:
+		return size <= KMALLOC_MAX_SIZE;
+	case BENCH_VMALLOC:
+		/* vmalloc may sleep to allocate page tables */
+		return gfp == GFP_KERNEL;
+	case BENCH_PAGES:
+		return get_order(size) <= KMEM_MAX_ORDER;
+	case BENCH_CACHE:
+		return size <= BENCH_CACHE_MAX;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Time @runs alloc/free pairs of @size bytes and fill in @res. @samples
+ * holds one latency per run. @bench_cache is only used for BENCH_CACHE.
+ */
+static void bench_one(enum bench_alloc alloc, unsigned int gfp_idx,
+		      size_t size, struct kmem_cache *bench_cache, u32 *samples,
+		      unsigned int runs, struct bench_result *res)
+{
+	gfp_t gfp = bench_gfps[gfp_idx].gfp;
+	unsigned int order = get_order(size);
+	u64 total = 0;
+	unsigned int i;
+
+	res->alloc = alloc;
+	res->gfp = gfp_idx;
+	res->size = size;
+	res->ops = runs;
+	res->failures = 0;
+
+	for (i = 0; i < runs; i++) {
+		u64 start = ktime_get_ns();
+		struct page *page;
+		void *ptr;
+
+		switch (alloc) {
+		case BENCH_KMALLOC:
+			ptr = kmalloc(size, gfp | __GFP_NOWARN);
+			kfree(ptr);
+			break;
+		case BENCH_VMALLOC:
+			ptr = vmalloc(size);
+			vfree(ptr);
+			break;
+		case BENCH_PAGES:
+			page = alloc_pages(gfp | __GFP_NOWARN, order);
+			ptr = page;
+			if (page)
+				__free_pages(page, order);
+			break;
+		case BENCH_CACHE:
+			ptr = kmem_cache_alloc(bench_cache, gfp | __GFP_NOWARN);
+			if (ptr)
+				kmem_cache_free(bench_cache, ptr);
+			break;
+		default:
+			ptr = NULL;
+			break;
+		}
+
+		samples[i] = min_t(u64, ktime_get_ns() - start, U32_MAX);
+		total += samples[i];
+		if (!ptr)
+			res->failures++;
+		cond_resched();
+	}
+
+	sort(samples, runs, sizeof(*samples), bench_cmp_u32, NULL);
+	res->mean_ns = div_u64(total, runs);
+	res->p99_ns = samples[(runs * 99) / 100];
+}
+
+/* Run the whole sweep with @iterations pairs per small configuration */
+static int kmem_bench_run(unsigned int iterations)
+{
+	unsigned int shift, alloc, g;
+	u32 *samples;
+
+	samples = kvmalloc_array(iterations, sizeof(*samples), GFP_KERNEL);
+	if (!samples)
+		return -ENOMEM;
+
+	mutex_lock(&bench_mutex);
+	bench_nr_results = 0;
+	for (shift = BENCH_MIN_SHIFT; shift <= BENCH_MAX_SHIFT; shift++) {
+		size_t size = 1UL << shift;
+		struct kmem_cache *bench_cache = NULL;
+		unsigned int runs = iterations;
+
+		/* Large sizes are slow; keep the total time per size similar */
+		if (size > BENCH_BIG_SIZE)
+			runs = max_t(unsigned int, BENCH_MIN_RUNS,
+				     iterations / (size / BENCH_BIG_SIZE));
+		runs = min(runs, iterations);
+
+		if (size <= BENCH_CACHE_MAX)
+			bench_cache = kmem_cache_create("kmem_demo_bench", size,
+							0, 0, NULL);
+
+		for (alloc = 0; alloc < NR_BENCH_ALLOCS; alloc++) {
+			if (alloc == BENCH_CACHE && !bench_cache)
+				continue;
+			for (g = 0; g < ARRAY_SIZE(bench_gfps); g++) {
+				if (!bench_supported(alloc, bench_gfps[g].gfp,
+						     size))
+					continue;
+				bench_one(alloc, g, size, bench_cache, samples,
+					  runs,
+					  &bench_results[bench_nr_results++]);
+			}
+		}
+
+		kmem_cache_destroy(bench_cache);
+	}
+	mutex_unlock(&bench_mutex);
+
+	kvfree(samples);
+	pr_info("kmem_demo: Allocator benchmark done, %u configurations\n",
+		bench_nr_results);
+	return 0;
+}
+
+/* Print the last benchmark run, if any; the caller holds bench_mutex */
+static void kmem_bench_show(struct seq_file *m)
+{
+	unsigned int i;
+
+	lockdep_assert_held(&bench_mutex);
+	if (bench_nr_results) {
+		seq_puts(m, "\n5. Allocator benchmark (alloc+free pairs):\n");
+		seq_printf(m, "   %-12s %-10s %8s %8s %10s %10s %8s\n",
+			   "allocator", "flags", "size", "ops", "ns/op",
+			   "p99 ns", "failed");
+	}
+	for (i = 0; i < bench_nr_results; i++) {
+		const struct bench_result *res = &bench_results[i];
+
+		seq_printf(m, "   %-12s %-10s %8u %8u %10llu %10llu %8u\n",
+			   bench_alloc_names[res->alloc],
+			   bench_gfps[res->gfp].name, res->size, res->ops,
+			   res->mean_ns, res->p99_ns, res->failures);
+	}
+	mutex_unlock(&bench_mutex);
+}
+
+/* "bench [iterations]" */
+static int kmem_cmd_bench(char *args)
+{
+	unsigned int iterations = BENCH_ITERATIONS;
+	char *arg = strsep(&args, " ");
+
+	if (arg && *arg && kstrtouint(arg, 0, &iterations))
+		return -EINVAL;
+	if (!iterations || iterations > BENCH_MAX_ITERATIONS)
+		return -EINVAL;
+	return kmem_bench_run(iterations);
+}
+
+/*
+ * Allocator scalability benchmark
+ *
+ * "scale [cpulist] [ms]" starts one kthread pinned to each of the first
+ * 1, 2, 4, ... CPUs of cpulist (default: all online CPUs) and has them all
+ * allocate and free for ms milliseconds. The xcpu patterns allocate on one
+ * CPU and free on another: each thread pushes what it allocates onto the
+ * lock-free inbox of the next thread and frees whatever arrives in its own
+ * inbox, so every object crosses CPUs. The atomic patterns allocate with
+ * GFP_ATOMIC and interrupts disabled, as an interrupt handler would. The
+ * result is the aggregate number of alloc/free pairs per second.
+ */
+enum scale_pattern {
+	SCALE_CACHE,
+	SCALE_KMALLOC,
+	SCALE_VMALLOC,
+	SCALE_CACHE_XCPU,
+	SCALE_KMALLOC_XCPU,
+	SCALE_POOL,
+	SCALE_POOL_XCPU,
+	SCALE_CACHE_ATOMIC,
+	SCALE_POOL_ATOMIC,
+	NR_SCALE_PATTERNS,
+};
+
+static const char *const scale_names[NR_SCALE_PATTERNS] = {
+	[SCALE_CACHE] = "demo_cache",
+	[SCALE_KMALLOC] = "kmalloc-256",
+	[SCALE_VMALLOC] = "vmalloc-16k",
+	[SCALE_CACHE_XCPU] = "demo_cache xcpu",
+	[SCALE_KMALLOC_XCPU] = "kmalloc-256 xcpu",
+	[SCALE_POOL] = "demo_pool",
+	[SCALE_POOL_XCPU] = "demo_pool xcpu",
+	[SCALE_CACHE_ATOMIC] = "demo_cache atomic",
+	[SCALE_POOL_ATOMIC] = "demo_pool atomic",
+};
+
+struct scale_run;
+
+/* One pinned benchmark thread */
+struct scale_thread {
+	struct scale_run *run;
+	unsigned int idx;
+	u64 ops; /* alloc/free pairs completed */
+	u64 failures; /* Allocations that returned NULL */
+	struct completion done;
+	struct llist_head inbox ____cacheline_aligned_in_smp; /* xcpu frees */
+};
+
+struct scale_run {
+	enum scale_pattern pattern;
+	unsigned int nr_threads;
+	bool go; /* Set once every thread is ready */
+	u64 deadline_ns;
+	wait_queue_head_t start_wq;
+	struct scale_thread *threads;
+};
+
+struct scale_result {
+	u8 pattern; /* enum scale_pattern */
+	u16 threads;
+	u64 ops_per_sec;
+	u64 failures;
+};
+
+static struct scale_result
+	scale_results[NR_SCALE_PATTERNS * SCALE_MAX_STEPS];
+static unsigned int scale_nr_results;
+
+static bool scale_is_xcpu(enum scale_pattern pattern)
+{
+	return pattern == SCALE_CACHE_XCPU || pattern == SCALE_KMALLOC_XCPU ||
+	       pattern == SCALE_POOL_XCPU;
+}
+
+/* Allocate one object for an xcpu pattern */
+static void *scale_xcpu_alloc(enum scale_pattern pattern)
+{
+	if (pattern == SCALE_CACHE_XCPU)
+		return kmem_cache_alloc(cache, GFP_KERNEL);
+	if (pattern == SCALE_POOL_XCPU)
+		return demo_pool_alloc(obj_pool, GFP_KERNEL);
+	return kmalloc(SCALE_KMALLOC_SIZE, GFP_KERNEL);
+}
+
+/* Free every object in @list, returning how many there were */
+static u64 scale_xcpu_free(enum scale_pattern pattern, struct llist_node *list)
+{
+	struct llist_node *node, *next;
+	u64 freed = 0;
+
+	llist_for_each_safe(node, next, list) {
+		if (pattern == SCALE_CACHE_XCPU)
+			kmem_cache_free(cache, node);
+		else if (pattern == SCALE_POOL_XCPU)
+			demo_pool_free(obj_pool, node);
+		else
+			kfree(node);
+		freed++;
+	}
+	return freed;
+}
+
+static int scale_thread_fn(void *data)
+{
+	struct scale_thread *t = data;
+	struct scale_run *run = t->run;
+	struct scale_thread *next = &run->threads[(t->idx + 1) % run->nr_threads];
+	unsigned long flags;
+	unsigned int i;
+	void *ptr;
+
+	/* Pairs with the release in scale_run_one(), publishing deadline_ns */
+	wait_event(run->start_wq, smp_load_acquire(&run->go));
+
+	while (ktime_get_ns() < run->deadline_ns) {
+		switch (run->pattern) {
+		case SCALE_CACHE:
+			for (i = 0; i < SCALE_BATCH; i++) {
+				ptr = kmem_cache_alloc(cache, GFP_KERNEL);
+				if (!ptr) {
+					t->failures++;
+					continue;
+				}
+				kmem_cache_free(cache, ptr);
+				t->ops++;
+			}
+			break;
+		case SCALE_KMALLOC:
+			for (i = 0; i < SCALE_BATCH; i++) {
+				ptr = kmalloc(SCALE_KMALLOC_SIZE, GFP_KERNEL);
+				if (!ptr) {
+					t->failures++;
+					continue;
+				}
+				kfree(ptr);
+				t->ops++;
+			}
+			break;
+		case SCALE_VMALLOC:
+			for (i = 0; i < SCALE_BATCH; i++) {
+				ptr = vmalloc(SCALE_VMALLOC_SIZE);
+				if (!ptr) {
+					t->failures++;
+					continue;
+				}
+				vfree(ptr);
+				t->ops++;
+			}
+			break;
+		case SCALE_POOL:
+			for (i = 0; i < SCALE_BATCH; i++) {
+				ptr = demo_pool_alloc(obj_pool, GFP_KERNEL);
+				if (!ptr) {
+					t->failures++;
+					continue;
+				}
+				demo_pool_free(obj_pool, ptr);
+				t->ops++;
+			}
+			break;
+		case SCALE_CACHE_ATOMIC:
+			for (i = 0; i < SCALE_BATCH; i++) {
+				local_irq_save(flags);
+				ptr = kmem_cache_alloc(cache, GFP_ATOMIC);
+				if (ptr)
+					kmem_cache_free(cache, ptr);
+				local_irq_restore(flags);
+				if (!ptr) {
+					t->failures++;
+					continue;
+				}
+				t->ops++;
+			}
+			break;
+		case SCALE_POOL_ATOMIC:
+			for (i = 0; i < SCALE_BATCH; i++) {
+				local_irq_save(flags);
+				ptr = demo_pool_alloc(obj_pool, GFP_ATOMIC);
+				if (ptr)
+					demo_pool_free(obj_pool, ptr);
+				local_irq_restore(flags);
+				if (!ptr) {
+					t->failures++;
+					continue;
+				}
+				t->ops++;
+			}
+			break;
+		default:
+			/* Objects are used as llist nodes while in flight */
+			for (i = 0; i < SCALE_BATCH; i++) {
+				ptr = scale_xcpu_alloc(run->pattern);
+				if (ptr)
+					llist_add(ptr, &next->inbox);
+				else
+					t->failures++;
+			}
+			t->ops += scale_xcpu_free(run->pattern,
+						  llist_del_all(&t->inbox));
+			break;
+		}
+		cond_resched();
+	}
+
+	complete(&t->done);
+	return 0;
+}
+
+/*
+ * Run @pattern on the first @nr CPUs of @cpus for @ms milliseconds. Only
+ * successful pairs count towards @ops_per_sec; allocations that returned
+ * NULL are added up in @failures.
+ */
+static int scale_run_one(enum scale_pattern pattern, const struct cpumask *cpus,
+			 unsigned int nr, unsigned int ms, u64 *ops_per_sec,
+			 u64 *failures)
+{
+	struct scale_run run = {
+		.pattern = pattern,
+		.nr_threads = nr,
+	};
+	unsigned int i, started = 0;
+	u64 start, ops = 0, fails = 0;
+	int cpu, ret = 0;
+
+	run.threads = kcalloc(nr, sizeof(*run.threads), GFP_KERNEL);
+	if (!run.threads)
+		return -ENOMEM;
+	init_waitqueue_head(&run.start_wq);
+
+	for_each_cpu(cpu, cpus) {
+		struct scale_thread *t = &run.threads[started];
+		struct task_struct *task;
+
+		if (started == nr)
+			break;
+		t->run = &run;
+		t->idx = started;
+		init_completion(&t->done);
+		init_llist_head(&t->inbox);
+
+		task = kthread_create_on_node(scale_thread_fn, t,
+					      cpu_to_node(cpu),
+					      "kmem_scale/%d", cpu);
+		if (IS_ERR(task)) {
+			ret = PTR_ERR(task);
+			break;
+		}
+		kthread_bind(task, cpu);
+		wake_up_process(task);
+		started++;
+	}
+
+	/* Release every thread at once; on error they exit immediately */
+	start = ktime_get_ns();
+	run.deadline_ns = ret ? 0 : start + (u64)ms * NSEC_PER_MSEC;
+	smp_store_release(&run.go, true);
+	wake_up_all(&run.start_wq);
+
+	for (i = 0; i < started; i++)
+		wait_for_completion(&run.threads[i].done);
+
+	/* Free objects still in flight between threads */
+	for (i = 0; i < started; i++) {
+		scale_xcpu_free(pattern, llist_del_all(&run.threads[i].inbox));
+		ops += run.threads[i].ops;
+		fails += run.threads[i].failures;
+	}
+
+	if (!ret) {
+		*ops_per_sec = div64_u64(ops * NSEC_PER_SEC,
+					 max_t(u64, ktime_get_ns() - start, 1));
+		*failures = fails;
+	}
+	kfree(run.threads);
+	return ret;
+}
+
+/* "scale [cpulist] [ms]" */
+static int kmem_cmd_scale(char *args)
+{
+	char *list = strsep(&args, " ");
+	char *arg = strsep(&args, " ");
+	unsigned int ms = SCALE_MS;
+	unsigned int nr, max_nr;
+	cpumask_var_t cpus;
+	int pattern, ret = 0;
+
+	if (!cache || !obj_pool)
+		return -ENODEV;
+	if (arg && *arg && kstrtouint(arg, 0, &ms))
+		return -EINVAL;
+	if (!ms || ms > SCALE_MAX_MS)
+		return -EINVAL;
+
+	if (!zalloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
+	if (list && *list && strcmp(list, "all") != 0) {
+		ret = cpulist_parse(list, cpus);
+		if (ret)
+			goto out;
+	} else {
+		cpumask_copy(cpus, cpu_online_mask);
+	}
+
+	/*
+	 * Hold off hotplug so the CPUs stay online while threads run, inside
+	 * bench_mutex as every bench command does.
+	 */
+	mutex_lock(&bench_mutex);
+	cpus_read_lock();
+	cpumask_and(cpus, cpus, cpu_online_mask);
+	max_nr = cpumask_weight(cpus);
+	if (!max_nr) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	scale_nr_results = 0;
+	for (pattern = 0; pattern < NR_SCALE_PATTERNS && !ret; pattern++) {
+		/* 1, 2, 4, ... threads, ending with all of them */
+		for (nr = 1;; nr = min(nr * 2, max_nr)) {
+			struct scale_result *res;
+			u64 ops_per_sec, failures;
+
+			/* Cross-CPU frees need a second thread */
+			if (scale_is_xcpu(pattern) && nr == 1) {
+				if (max_nr == 1)
+					break;
+				continue;
+			}
+			if (scale_nr_results == ARRAY_SIZE(scale_results))
+				break;
+
+			ret = scale_run_one(pattern, cpus, nr, ms,
+					    &ops_per_sec, &failures);
+			if (ret)
+				break;
+			res = &scale_results[scale_nr_results++];
+			res->pattern = pattern;
+			res->threads = nr;
+			res->ops_per_sec = ops_per_sec;
+			res->failures = failures;
+			if (nr == max_nr)
+				break;
+		}
+	}
+
+out_unlock:
+	cpus_read_unlock();
+	mutex_unlock(&bench_mutex);
+out:
+	free_cpumask_var(cpus);
+	return ret;
+}
+
+/* Print the last scalability run, if any; the caller holds bench_mutex */
+static void kmem_scale_show(struct seq_file *m)
+{
+	unsigned int i;
+
+	lockdep_assert_held(&bench_mutex);
+	if (scale_nr_results) {
+		seq_puts(m, "\n6. Allocator scalability (alloc+free pairs):\n");
+		seq_printf(m, "   %-18s %8s %14s %14s %10s\n", "pattern",
+			   "threads", "total ops/s", "ops/s/thread", "failed");
+	}
+	for (i = 0; i < scale_nr_results; i++) {
+		const struct scale_result *res = &scale_results[i];
+
+		seq_printf(m, "   %-18s %8u %14llu %14llu %10llu\n",
+			   scale_names[res->pattern], res->threads,
+			   res->ops_per_sec,
+			   div_u64(res->ops_per_sec, res->threads),
+			   res->failures);
+	}
+	mutex_unlock(&bench_mutex);
+}
+
+/*
+ * Access-cost measurement, shared by the numa and tlb benchmarks
+ *
+ * A region is one or more equally sized, separately allocated segments.
+ * region_chase() follows a pointer cycle through every cache line of the
+ * region in random order: each load depends on the previous one, so loads
+ * cannot overlap and the hardware prefetcher cannot guess the next
+ * address. region_stream() reads the segments front to back. Both run for
+ * the given time and return the nanoseconds spent, counting the loads or
+ * bytes in @count.
+ */
+struct kmem_region {
+	void **segs;
+	unsigned int nr_segs;
+	size_t seg_size;
+};
+
+/* Address of cache line @line of @r */
+static void *region_line(const struct kmem_region *r, size_t line)
+{
+	size_t off = line * L1_CACHE_BYTES;
+
+	return r->segs[off / r->seg_size] + off % r->seg_size;
+}
+
+static u32 region_random_below(u32 ceil)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
+	return get_random_u32_below(ceil);
+#else
+	return prandom_u32_max(ceil);
+#endif
+}
+
+/* Link every cache line of @r into one cycle in random order */
+static int region_build_chase(const struct kmem_region *r, void **start)
+{
+	size_t lines = r->nr_segs * r->seg_size / L1_CACHE_BYTES, i, j;
+	u32 *order, tmp;
+
+	order = kvmalloc_array(lines, sizeof(*order), GFP_KERNEL);
+	if (!order)
+		return -ENOMEM;
+	for (i = 0; i < lines; i++)
+		order[i] = i;
+	for (i = lines - 1; i > 0; i--) {
+		j = region_random_below(i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	for (i = 0; i < lines; i++)
+		*(void **)region_line(r, order[i]) =
+			region_line(r, order[(i + 1) % lines]);
+
+	*start = region_line(r, order[0]);
+	kvfree(order);
+	return 0;
+}
+
+static u64 region_chase(void *start, unsigned int ms, u64 *loads,
+			unsigned long *sink)
+{
+	u64 begin = ktime_get_ns(), now;
+	u64 deadline = begin + (u64)ms * NSEC_PER_MSEC;
+	void **p = start;
+	unsigned int i;
+
+	*loads = 0;
+	do {
+		for (i = 0; i < REGION_CHASE_BATCH; i++)
+			p = *p;
+		*loads += REGION_CHASE_BATCH;
+		now = ktime_get_ns();
+	} while (now < deadline);
+
+	/* Keeps the loads from being optimized away */
+	WRITE_ONCE(*sink, (unsigned long)p);
+	return now - begin;
+}
+
+static u64 region_stream(const struct kmem_region *r, unsigned int ms,
+			 u64 *bytes, unsigned long *sink)
+{
+	u64 begin = ktime_get_ns(), now;
+	u64 deadline = begin + (u64)ms * NSEC_PER_MSEC;
+	unsigned int seg = 0;
+	unsigned long sum = 0;
+	size_t off = 0, i;
+
+	*bytes = 0;
+	do {
+		const unsigned long *word = r->segs[seg] + off;
+
+		for (i = 0; i < REGION_STREAM_CHUNK / sizeof(*word); i++)
+			sum += word[i];
+		*bytes += REGION_STREAM_CHUNK;
+		off += REGION_STREAM_CHUNK;
+		if (off == r->seg_size) {
+			off = 0;
+			if (++seg == r->nr_segs) {
+				seg = 0;
+				cond_resched();
+			}
+		}
+		now = ktime_get_ns();
+	} while (now < deadline);
+
+	WRITE_ONCE(*sink, sum);
+	return now - begin;
+}
+
+/* Print @ps picoseconds as nanoseconds with three decimals */
+static void kmem_show_ns(struct seq_file *m, u64 ps)
+{
+	u32 rem;
+	u64 ns = div_u64_rem(ps, 1000, &rem);
+
+	seq_printf(m, " %6llu.%03u", ns, rem);
+}
+
+/*
+ * NUMA access benchmark
+ *
+ * "numa [MB] [ms]" allocates a buffer on every node with memory and, from
+ * a kthread pinned to the first CPU of every node with CPUs, measures the
+ * buffer two ways for ms milliseconds each: a dependent pointer chase in
+ * random cache-line order, whose loads cannot overlap or be prefetched
+ * (latency), and a sequential read of the whole buffer (bandwidth). Each
+ * CPU node x memory node pair is one result, so the diagonal is local
+ * access and everything else remote. Nodes come from the firmware or from
+ * numa=fake=, so a single-socket machine or VM can still run it.
+ */
+struct numa_run {
+	struct kmem_region region;
+	void *chase; /* Start of the pointer cycle */
+	unsigned int ms;
+	u64 loads, chase_ns;
+	u64 bytes, stream_ns;
+	unsigned long sink;
+	struct completion done;
+};
+
+struct numa_result {
+	u16 cpu_node, mem_node;
+	u16 distance; /* node_distance(), 10 is local */
+	u8 on_node_pct; /* Buffer pages actually on mem_node */
+	u32 cpu;
+	u64 chase_ps; /* Picoseconds per dependent load */
+	u64 stream_mbps;
+};
+
+static struct numa_result numa_results[NUMA_MAX_RESULTS];
+static unsigned int numa_nr_results;
+static unsigned int numa_mb;
+
+/* Percentage of the pages of vmalloc'ed @buf that are on @node */
+static u8 numa_on_node_pct(const void *buf, size_t size, int node)
+{
+	size_t off, on = 0;
+
+	for (off = 0; off < size; off += PAGE_SIZE)
+		if (page_to_nid(vmalloc_to_page(buf + off)) == node)
+			on++;
+	return div_u64((u64)on * 100, size >> PAGE_SHIFT);
+}
+
+static int numa_thread_fn(void *data)
+{
+	struct numa_run *run = data;
+
+	run->chase_ns = region_chase(run->chase, run->ms, &run->loads,
+				     &run->sink);
+	run->stream_ns = region_stream(&run->region, run->ms, &run->bytes,
+				       &run->sink);
+	complete(&run->done);
+	return 0;
+}
+
+/* Measure the buffer in @run from a kthread pinned to @cpu */
+static int numa_run_one(struct numa_run *run, int cpu)
+{
+	struct task_struct *task;
+
+	run->loads = run->chase_ns = 0;
+	run->bytes = run->stream_ns = 0;
+	init_completion(&run->done);
+
+	task = kthread_create_on_node(numa_thread_fn, run, cpu_to_node(cpu),
+				      "kmem_numa/%d", cpu);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	kthread_bind(task, cpu);
+	wake_up_process(task);
+	wait_for_completion(&run->done);
+	return 0;
+}
+
+/* "numa [MB] [ms]" */
+static int kmem_cmd_numa(char *args)
+{
+	char *arg = strsep(&args, " ");
+	unsigned int mb = NUMA_MB, ms = NUMA_MS;
+	struct numa_run run = {};
+	int mem_node, cpu_node, cpu, ret = 0;
+	void *buf;
+
+	if (arg && *arg && kstrtouint(arg, 0, &mb))
+		return -EINVAL;
+	arg = strsep(&args, " ");
+	if (arg && *arg && kstrtouint(arg, 0, &ms))
+		return -EINVAL;
+	if (!mb || mb > NUMA_MAX_MB || !ms || ms > SCALE_MAX_MS)
+		return -EINVAL;
+	run.region.segs = &buf;
+	run.region.nr_segs = 1;
+	run.region.seg_size = (size_t)mb << 20;
+	run.ms = ms;
+
+	mutex_lock(&bench_mutex);
+	numa_nr_results = 0;
+	numa_mb = mb;
+	for_each_node_state(mem_node, N_MEMORY) {
+		buf = vmalloc_node(run.region.seg_size, mem_node);
+		if (!buf) {
+			ret = -ENOMEM;
+			break;
+		}
+		ret = region_build_chase(&run.region, &run.chase);
+		if (ret) {
+			vfree(buf);
+			break;
+		}
+
+		/* Hold off hotplug so the chosen CPU stays online */
+		cpus_read_lock();
+		for_each_node_state(cpu_node, N_CPU) {
+			struct numa_result *res;
+
+			if (numa_nr_results == ARRAY_SIZE(numa_results))
+				break;
+			cpu = cpumask_first_and(cpumask_of_node(cpu_node),
+						cpu_online_mask);
+			if (cpu >= nr_cpu_ids)
+				continue;
+
+			ret = numa_run_one(&run, cpu);
+			if (ret)
+				break;
+			res = &numa_results[numa_nr_results++];
+			res->cpu_node = cpu_node;
+			res->mem_node = mem_node;
+			res->distance = node_distance(cpu_node, mem_node);
+			res->on_node_pct = numa_on_node_pct(buf,
+							    run.region.seg_size,
+							    mem_node);
+			res->cpu = cpu;
+			res->chase_ps = div64_u64(run.chase_ns * 1000,
+						  max_t(u64, run.loads, 1));
+			res->stream_mbps = div64_u64(run.bytes * 1000,
+						     max_t(u64, run.stream_ns, 1));
+		}
+		cpus_read_unlock();
+		vfree(buf);
+		if (ret)
+			break;
+	}
+	mutex_unlock(&bench_mutex);
+	return ret;
+}
+
+/* Print the last NUMA run, if any; the caller holds bench_mutex */
+static void kmem_numa_show(struct seq_file *m)
+{
+	unsigned int i;
+
+	lockdep_assert_held(&bench_mutex);
+	if (numa_nr_results) {
+		seq_printf(m, "\n7. NUMA access (%u MB buffer per node):\n",
+			   numa_mb);
+		seq_printf(m, "   %8s %8s %5s %8s %7s %10s %10s\n", "cpu-node",
+			   "mem-node", "cpu", "distance", "on-node", "ns/load",
+			   "MB/s");
+	}
+	for (i = 0; i < numa_nr_results; i++) {
+		const struct numa_result *res = &numa_results[i];
+
+		seq_printf(m, "   %8u %8u %5u %8u %6u%%", res->cpu_node,
+			   res->mem_node, res->cpu, res->distance,
+			   res->on_node_pct);
+		kmem_show_ns(m, res->chase_ps);
+		seq_printf(m, " %10llu%s\n", res->stream_mbps,
+			   res->cpu_node == res->mem_node ? "" : "  remote");
+	}
+	mutex_unlock(&bench_mutex);
+}
+
+/*
+ * vmalloc mapping benchmark
+ *
+ * "tlb [ms]" builds three VMALLOC_SIZE regions and runs the random
+ * pointer chase and the sequential read over each: vmalloc with base-page
+ * PTEs, vmalloc_huge() with PMD mappings where the architecture supports
+ * them, and physically contiguous high-order pages read through the
+ * kernel's linear map. The region is small enough to sit largely in the
+ * last-level cache, so the random result is dominated by TLB misses and
+ * page walks, i.e. by how the region is mapped rather than by DRAM.
+ */
+enum tlb_region {
+	TLB_VMALLOC,
+	TLB_VMALLOC_HUGE,
+	TLB_CONTIG,
+	NR_TLB_REGIONS,
+};
+
+static const char *const tlb_names[NR_TLB_REGIONS] = {
+	[TLB_VMALLOC] = "vmalloc",
+	[TLB_VMALLOC_HUGE] = "vmalloc_huge",
+	[TLB_CONTIG] = "contig pages",
+};
+
+struct tlb_result {
+	int err; /* Non-zero if the region could not be allocated */
+	u64 chase_ps; /* Picoseconds per random access */
+	u64 stream_ps; /* Picoseconds per sequential word */
+};
+
+static struct tlb_result tlb_results[NR_TLB_REGIONS];
+static bool tlb_valid;
+
+/* Largest order of one contiguous segment of the region */
+#define TLB_CONTIG_ORDER min_t(unsigned int, get_order(VMALLOC_SIZE), \
+			       KMEM_MAX_ORDER)
+
+/* Allocate the segments of region @which into @r */
+static int tlb_region_alloc(enum tlb_region which, struct kmem_region *r)
+{
+	unsigned int i, order = TLB_CONTIG_ORDER;
+	struct page *page;
+
+	if (which != TLB_CONTIG) {
+#ifndef KMEM_HAVE_VMALLOC_HUGE
+		if (which == TLB_VMALLOC_HUGE)
+			return -EOPNOTSUPP;
+#endif
+		r->nr_segs = 1;
+		r->seg_size = VMALLOC_SIZE;
+		r->segs[0] = kmem_vmalloc(VMALLOC_SIZE,
+					  which == TLB_VMALLOC_HUGE,
+					  NUMA_NO_NODE);
+		return r->segs[0] ? 0 : -ENOMEM;
+	}
+
+	r->seg_size = PAGE_SIZE << order;
+	r->nr_segs = 0;
+	for (i = 0; i < VMALLOC_SIZE / r->seg_size; i++) {
+		page = alloc_pages(GFP_KERNEL | __GFP_NOWARN, order);
+		if (!page)
+			return -ENOMEM;
+		r->segs[r->nr_segs++] = page_address(page);
+	}
+	return 0;
+}
+
+static void tlb_region_free(enum tlb_region which, struct kmem_region *r)
+{
+	unsigned int i;
+
+	for (i = 0; i < r->nr_segs; i++) {
+		if (which == TLB_CONTIG)
+			free_pages((unsigned long)r->segs[i], TLB_CONTIG_ORDER);
+		else
+			vfree(r->segs[i]);
+	}
+	r->nr_segs = 0;
+}
+
+/* "tlb [ms]" */
+static int kmem_cmd_tlb(char *args)
+{
+	char *arg = strsep(&args, " ");
+	unsigned int ms = TLB_MS;
+	struct kmem_region r = {};
+	unsigned long sink;
+	u64 count, ns;
+	int which;
+	void *start;
+
+	if (arg && *arg && kstrtouint(arg, 0, &ms))
+		return -EINVAL;
+	if (!ms || ms > SCALE_MAX_MS)
+		return -EINVAL;
+
+	/* Enough segment pointers for the smallest contiguous segment */
+	r.segs = kcalloc(VMALLOC_SIZE / (PAGE_SIZE << TLB_CONTIG_ORDER),
+			 sizeof(*r.segs), GFP_KERNEL);
+	if (!r.segs)
+		return -ENOMEM;
+
+	mutex_lock(&bench_mutex);
+	tlb_valid = false;
+	for (which = 0; which < NR_TLB_REGIONS; which++) {
+		struct tlb_result *res = &tlb_results[which];
+
+		memset(res, 0, sizeof(*res));
+		res->err = tlb_region_alloc(which, &r);
+		if (!res->err)
+			res->err = region_build_chase(&r, &start);
+		if (res->err) {
+			tlb_region_free(which, &r);
+			continue;
+		}
+
+		ns = region_chase(start, ms, &count, &sink);
+		res->chase_ps = div64_u64(ns * 1000, max_t(u64, count, 1));
+		ns = region_stream(&r, ms, &count, &sink);
+		count /= sizeof(unsigned long);
+		res->stream_ps = div64_u64(ns * 1000, max_t(u64, count, 1));
+		tlb_region_free(which, &r);
+	}
+	tlb_valid = true;
+	mutex_unlock(&bench_mutex);
+
+	kfree(r.segs);
+	return 0;
+}
+
+/*
+ * Print the last mapping benchmark run, if any; the caller holds
+ * bench_mutex
+ */
+static void kmem_tlb_show(struct seq_file *m)
+{
+	unsigned int i;
+
+	lockdep_assert_held(&bench_mutex);
+	if (tlb_valid) {
+		seq_printf(m, "\n8. vmalloc mapping cost (%d MB region, ns/access):\n",
+			   VMALLOC_SIZE >> 20);
+		seq_printf(m, "   %-14s %10s %10s\n", "region", "random",
+			   "stream");
+	}
+	for (i = 0; tlb_valid && i < NR_TLB_REGIONS; i++) {
+		const struct tlb_result *res = &tlb_results[i];
+
+		seq_printf(m, "   %-14s", tlb_names[i]);
+		if (res->err) {
+			seq_printf(m, " unavailable (%d)\n", res->err);
+			continue;
+		}
+		kmem_show_ns(m, res->chase_ps);
+		kmem_show_ns(m, res->stream_ps);
+		seq_puts(m, "\n");
+	}
+	mutex_unlock(&bench_mutex);
+}
+
+/*
+ * Fragmentation stress
+ *
+ * "frag [pattern] [seconds] [pin_mb]" first fragments memory by pinning
+ * pin_mb megabytes of unmovable pages with one of these patterns:
+ *
+ *   none     pin nothing
+ *   checker  allocate order-0 pages and free every other one, leaving
+ *            single-page holes that cannot merge into larger blocks
+ *   random   allocate blocks of order 0-3 and free a random half
+ *
+ * It then cycles through every order from 0 to KMEM_MAX_ORDER for the
+ * given time, allocating one block per step the way a driver would for a
+ * jumbo buffer (GFP_KERNEL, no retrying, no warnings) and keeping the last
+ * FRAG_HOLD blocks of each order, so blocks of all sizes churn together.
+ * Per order it records attempts, successes and a latency histogram. The
+ * compaction and direct reclaim stalls come from the global vmstat event
+ * counters, so they include anything else the system did meanwhile.
+ */
+enum frag_pattern {
+	FRAG_NONE,
+	FRAG_CHECKER,
+	FRAG_RANDOM,
+	NR_FRAG_PATTERNS,
+};
+
+static const char *const frag_names[NR_FRAG_PATTERNS] = {
+	[FRAG_NONE] = "none",
+	[FRAG_CHECKER] = "checker",
+	[FRAG_RANDOM] = "random",
+};
+
+struct frag_order {
+	u64 attempts, successes;
+	u64 hist[FRAG_HIST_BUCKETS];
+};
+
+enum frag_event {
+	FRAG_COMPACT_STALL,
+	FRAG_COMPACT_FAIL,
+	FRAG_COMPACT_SUCCESS,
+	FRAG_RECLAIM_STALL,
+	NR_FRAG_EVENTS,
+};
+
+static const char *const frag_event_names[NR_FRAG_EVENTS] = {
+	[FRAG_COMPACT_STALL] = "compact_stall",
+	[FRAG_COMPACT_FAIL] = "compact_fail",
+	[FRAG_COMPACT_SUCCESS] = "compact_success",
+	[FRAG_RECLAIM_STALL] = "allocstall",
+};
+
+static struct frag_order frag_orders[KMEM_MAX_ORDER + 1];
+static u64 frag_events[NR_FRAG_EVENTS];
+static enum frag_pattern frag_pattern;
+static unsigned int frag_seconds, frag_pin_mb;
+static u64 frag_pinned_pages;
+static bool frag_valid;
+
+static const char *const frag_hist_names[FRAG_HIST_BUCKETS] = {
+	"<1us", "<4us", "<16us", "<64us", "<256us", "<1ms", "<4ms", ">=4ms",
+};
+
+/* Histogram bucket of @ns: factors of four from 1us up */
+static unsigned int frag_bucket(u64 ns)
+{
+	return min_t(unsigned int, (fls64(ns >> 10) + 1) / 2,
+		     FRAG_HIST_BUCKETS - 1);
+}
+
+/*
+ * Read the compaction and reclaim stall counters into @out. Without
+ * CONFIG_VM_EVENT_COUNTERS (or CONFIG_COMPACTION) they stay zero.
+ * all_vm_events() takes cpus_read_lock(), so callers holding bench_mutex
+ * follow its lock order.
+ */
+static int frag_read_events(u64 *out)
+{
+#ifdef CONFIG_VM_EVENT_COUNTERS
+	unsigned long *ev;
+	int zid;
+
+	ev = kcalloc(NR_VM_EVENT_ITEMS, sizeof(*ev), GFP_KERNEL);
+	if (!ev)
+		return -ENOMEM;
+	all_vm_events(ev);
+
+#ifdef CONFIG_COMPACTION
+	out[FRAG_COMPACT_STALL] = ev[COMPACTSTALL];
+	out[FRAG_COMPACT_FAIL] = ev[COMPACTFAIL];
+	out[FRAG_COMPACT_SUCCESS] = ev[COMPACTSUCCESS];
+#endif
+	/* One ALLOCSTALL counter per zone type, laid out like the zones */
+	out[FRAG_RECLAIM_STALL] = 0;
+	for (zid = 0; zid < MAX_NR_ZONES; zid++)
+		out[FRAG_RECLAIM_STALL] +=
+			ev[ALLOCSTALL_NORMAL - ZONE_NORMAL + zid];
+	kfree(ev);
+#endif
+	return 0;
+}
+
+/* Free every block on @list, each tagged with its order in page_private */
+static void frag_free_list(struct list_head *list)
+{
+	struct page *page, *tmp;
+
+	list_for_each_entry_safe(page, tmp, list, lru) {
+		list_del(&page->lru);
+		__free_pages(page, page_private(page));
+	}
+}
+
+/*
+ * Pin about @pin_mb megabytes in the layout of @pattern onto @pinned,
+ * returning the number of pages pinned
+ */
+static u64 frag_pin(enum frag_pattern pattern, unsigned int pin_mb,
+		    struct list_head *pinned)
+{
+	u64 target = (u64)pin_mb << (20 - PAGE_SHIFT), pages = 0;
+	struct page *page, *tmp;
+	unsigned int order = 0;
+	LIST_HEAD(all);
+	bool keep = false;
+
+	if (pattern == FRAG_NONE)
+		return 0;
+
+	/* Allocate twice the target, then free half of it */
+	while (pages < 2 * target) {
+		if (pattern == FRAG_RANDOM)
+			order = region_random_below(4);
+		page = alloc_pages(GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY,
+				   order);
+		if (!page)
+			break;
+		set_page_private(page, order);
+		list_add_tail(&page->lru, &all);
+		pages += 1 << order;
+		if (fatal_signal_pending(current))
+			break;
+		cond_resched();
+	}
+
+	pages = 0;
+	list_for_each_entry_safe(page, tmp, &all, lru) {
+		if (pattern == FRAG_CHECKER)
+			keep = !keep;
+		else
+			keep = region_random_below(2);
+		if (!keep)
+			continue;
+		list_move_tail(&page->lru, pinned);
+		pages += 1 << page_private(page);
+	}
+	frag_free_list(&all);
+	return pages;
+}
+
+/* "frag [pattern] [seconds] [pin_mb]" */
+static int kmem_cmd_frag(char *args)
+{
+	char *name = strsep(&args, " ");
+	char *arg = strsep(&args, " ");
+	unsigned int seconds = FRAG_SECONDS, pin_mb = FRAG_PIN_MB;
+	struct page *held[KMEM_MAX_ORDER + 1][FRAG_HOLD] = {};
+	enum frag_pattern pattern = FRAG_CHECKER;
+	u64 before[NR_FRAG_EVENTS] = {}, after[NR_FRAG_EVENTS] = {};
+	unsigned int order = 0, slot = 0, i;
+	u64 deadline, start, ns;
+	LIST_HEAD(pinned);
+	struct page *page;
+	int ret;
+
+	if (name && *name) {
+		for (i = 0; i < NR_FRAG_PATTERNS; i++)
+			if (strcmp(name, frag_names[i]) == 0)
+				break;
+		if (i == NR_FRAG_PATTERNS)
+			return -EINVAL;
+		pattern = i;
+	}
+	if (arg && *arg && kstrtouint(arg, 0, &seconds))
+		return -EINVAL;
+	arg = strsep(&args, " ");
+	if (arg && *arg && kstrtouint(arg, 0, &pin_mb))
+		return -EINVAL;
+	if (!seconds || seconds > FRAG_MAX_SECONDS || pin_mb > FRAG_MAX_PIN_MB)
+		return -EINVAL;
+
+	mutex_lock(&bench_mutex);
+	frag_valid = false;
+	memset(frag_orders, 0, sizeof(frag_orders));
+	frag_pattern = pattern;
+	frag_seconds = seconds;
+	frag_pin_mb = pin_mb;
+	frag_pinned_pages = frag_pin(pattern, pin_mb, &pinned);
+
+	ret = frag_read_events(before);
+	if (ret)
+		goto out;
+
+	deadline = ktime_get_ns() + (u64)seconds * NSEC_PER_SEC;
+	while (ktime_get_ns() < deadline) {
+		struct frag_order *fo = &frag_orders[order];
+
+		/* Make room by freeing the oldest block of this order */
+		if (held[order][slot]) {
+			__free_pages(held[order][slot], order);
+			held[order][slot] = NULL;
+		}
+
+		start = ktime_get_ns();
+		page = alloc_pages(GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY,
+				   order);
+		ns = ktime_get_ns() - start;
+
+		fo->attempts++;
+		fo->hist[frag_bucket(ns)]++;
+		if (page) {
+			fo->successes++;
+			held[order][slot] = page;
+		}
+
+		if (++order > KMEM_MAX_ORDER) {
+			order = 0;
+			slot = (slot + 1) % FRAG_HOLD;
+			if (fatal_signal_pending(current))
+				break;
+			cond_resched();
+		}
+	}
+
+	ret = frag_read_events(after);
+	if (!ret) {
+		for (i = 0; i < NR_FRAG_EVENTS; i++)
+			frag_events[i] = after[i] - before[i];
+		frag_valid = true;
+	}
+
+out:
+	for (order = 0; order <= KMEM_MAX_ORDER; order++)
+		for (slot = 0; slot < FRAG_HOLD; slot++)
+			if (held[order][slot])
+				__free_pages(held[order][slot], order);
+	frag_free_list(&pinned);
+	mutex_unlock(&bench_mutex);
+	return ret;
+}
+
+/*
+ * Print the last fragmentation run, if any; the caller holds bench_mutex
+ */
+static void kmem_frag_show(struct seq_file *m)
+{
+	unsigned int order, i;
+
+	lockdep_assert_held(&bench_mutex);
+	if (!frag_valid)
+		return;
+
+	seq_printf(m, "\n9. Fragmentation stress (%s, %u s, %u MB requested, %llu MB pinned):\n",
+		   frag_names[frag_pattern], frag_seconds, frag_pin_mb,
+		   frag_pinned_pages >> (20 - PAGE_SHIFT));
+	seq_printf(m, "   %5s %10s %8s", "order", "attempts", "success");
+	for (i = 0; i < FRAG_HIST_BUCKETS; i++)
+		seq_printf(m, " %9s", frag_hist_names[i]);
+	seq_puts(m, "\n");
+
+	for (order = 0; order <= KMEM_MAX_ORDER; order++) {
+		const struct frag_order *fo = &frag_orders[order];
+
+		seq_printf(m, "   %5u %10llu %7llu%%", order, fo->attempts,
+			   div64_u64(fo->successes * 100,
+				     max_t(u64, fo->attempts, 1)));
+		for (i = 0; i < FRAG_HIST_BUCKETS; i++)
+			seq_printf(m, " %9llu", fo->hist[i]);
+		seq_puts(m, "\n");
+	}
+
+	seq_puts(m, "   vmstat deltas:");
+	for (i = 0; i < NR_FRAG_EVENTS; i++)
+		seq_printf(m, " %s %llu", frag_event_names[i], frag_events[i]);
+	seq_puts(m, "\n");
+}
+
+/* "objects <count>" */
+static int kmem_cmd_objects(char *args)
+{
+	char *arg = strsep(&args, " ");
+	unsigned long count;
+
+	if (!obj_pool)
+		return -ENODEV;
+	if (!arg || !*arg || kstrtoul(arg, 0, &count))
+		return -EINVAL;
+	if (count > OBJECTS_MAX)
+		return -EINVAL;
+	return demo_objects_resize(count);
+}
+
+/* "reserve [n]" */
+static int kmem_cmd_reserve(char *args)
+{
+	char *arg = strsep(&args, " ");
+	unsigned int n = 2 * POOL_RESERVE;
+	int ret;
+
+	if (!obj_pool)
+		return -ENODEV;
+	if (arg && *arg && kstrtouint(arg, 0, &n))
+		return -EINVAL;
+	if (!n || n > RESERVE_TEST_MAX)
+		return -EINVAL;
+
+	mutex_lock(&bench_mutex);
+	ret = demo_pool_reserve_test(obj_pool, n);
+	mutex_unlock(&bench_mutex);
+	return ret;
+}
+
+/* Commands accepted by writes to /proc/kmem_demo */
+static const struct {
+	const char *name;
+	int (*run)(char *args);
+} kmem_cmds[] = {
+	{ "bench", kmem_cmd_bench },
+	{ "scale", kmem_cmd_scale },
+	{ "numa", kmem_cmd_numa },
+	{ "tlb", kmem_cmd_tlb },
+	{ "frag", kmem_cmd_frag },
+	{ "objects", kmem_cmd_objects },
+	{ "reserve", kmem_cmd_reserve },
+};
+
+/*
+ * Called for writes to /proc/kmem_demo. The first word selects a command
+ * and the rest is passed to it. The command runs in the writer's context,
+ * so the write returns once it is done.
+ */
+static ssize_t kmem_demo_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	char buf[CMD_MAX];
+	char *args, *name;
+	unsigned int i;
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	args = strim(buf);
+	name = strsep(&args, " ");
+	for (i = 0; i < ARRAY_SIZE(kmem_cmds); i++) {
+		if (strcmp(name, kmem_cmds[i].name) == 0) {
+			ret = kmem_cmds[i].run(args ? skip_spaces(args) : NULL);
+			return ret < 0 ? ret : count;
+		}
+	}
+
+	return -EINVAL;
+}
+
 /* ProcFS handlers for displaying memory information */
-static int kmem_demo_show(struct seq_file *m, void *v)
+static void kmem_demo_show_summary(struct seq_file *m)
 {
+	unsigned long nr_objects;
+
 	seq_puts(m, "Kernel Memory Management Demo Module\n");
 	seq_puts(m, "==================================\n\n");
 
@@ -137,18 +2305,32 @@ static int kmem_demo_show(struct seq_file *m, void *v)
 	seq_printf(m, "1. kmalloc:\n");
 	seq_printf(m, "   Size: %d bytes\n", KMALLOC_SIZE);
 	seq_printf(m, "   Address: 0x%px\n", kmalloc_ptr);
+	if (kmalloc_ptr)
+		seq_printf(m, "   Node: %d\n", kmem_addr_node(kmalloc_ptr));
 	seq_printf(m, "   Flags used: GFP_KERNEL\n\n");
 
 	/* Show vmalloc information */
 	seq_printf(m, "2. vmalloc:\n");
 	seq_printf(m, "   Size: %d bytes\n", VMALLOC_SIZE);
-	seq_printf(m, "   Address: 0x%px\n\n", vmalloc_ptr);
+	seq_printf(m, "   Mapping: %s\n",
+		   vmalloc_huge_map && IS_ENABLED(KMEM_HAVE_VMALLOC_HUGE) ?
+			   "huge pages requested (vmalloc_huge)" :
+			   "base pages");
+	seq_printf(m, "   Address: 0x%px\n", vmalloc_ptr);
+	if (vmalloc_ptr)
+		seq_printf(m, "   Node: %d (first page)\n",
+			   kmem_addr_node(vmalloc_ptr));
+	seq_puts(m, "\n");
 
 	/* Show get_free_pages information */
 	seq_printf(m, "3. __get_free_pages:\n");
 	seq_printf(m, "   Order: %d (2^%d pages)\n", PAGE_ORDER, PAGE_ORDER);
 	seq_printf(m, "   Size: %lu bytes\n", PAGE_SIZE << PAGE_ORDER);
-	seq_printf(m, "   Address: 0x%lx\n\n", page_ptr);
+	seq_printf(m, "   Address: 0x%lx\n", page_ptr);
+	if (page_ptr)
+		seq_printf(m, "   Node: %d\n",
+			   kmem_addr_node((void *)page_ptr));
+	seq_puts(m, "\n");
 
 	/* Show kmem_cache information */
 	seq_printf(m, "4. kmem_cache:\n");
@@ -160,21 +2342,136 @@ static int kmem_demo_show(struct seq_file *m, void *v)
 		seq_printf(m, "   Object address: 0x%px\n", cache_ptr);
 		seq_printf(m, "   Object id: %d\n", obj->id);
 		seq_printf(m, "   Object name: %s\n", obj->name);
+		seq_printf(m, "   Node: %d\n", kmem_addr_node(cache_ptr));
+	}
+	if (obj_pool)
+		demo_pool_show(m, obj_pool);
+
+	/* A running benchmark holds bench_mutex; don't wait behind it */
+	if (mutex_trylock(&bench_mutex)) {
+		kmem_bench_show(m);
+		kmem_scale_show(m);
+		kmem_numa_show(m);
+		kmem_tlb_show(m);
+		kmem_frag_show(m);
+		mutex_unlock(&bench_mutex);
+	} else {
+		seq_puts(m, "\n   A benchmark is running; its results and those of earlier runs are listed once it finishes.\n");
+	}
+
+	nr_objects = READ_ONCE(demo_nr_objects);
+	if (nr_objects)
+		seq_printf(m, "\n10. demo_struct inventory (%lu objects):\n",
+			   nr_objects);
+}
+
+/*
+ * /proc/kmem_demo is a seq_file iterator: record 0 is the summary above
+ * and record n is the (n-1)th object of the inventory, one line each.
+ * seq_file stops and restarts the iteration at every read() and whenever
+ * its buffer fills, so the iterator keeps a cursor in the open file: the
+ * object at the position it will be asked for next. If the inventory has
+ * not changed since, start() resumes from the cursor in O(1) and a full
+ * dump stays linear in the number of objects, using one page of buffer.
+ *
+ * The summary needs no objects_mutex, so it is only taken once the
+ * iterator moves onto the inventory: it is held exactly while the record
+ * last returned by start() or next() is not SEQ_START_TOKEN. A reader
+ * therefore never holds objects_mutex while it waits for anything else,
+ * and "objects" commands are never stalled behind a summary.
+ */
+struct kmem_demo_iter {
+	struct demo_struct *obj; /* Object at pos */
+	loff_t pos;
+	u64 gen; /* demo_objects_gen when obj was found */
+};
+
+static void *kmem_demo_seq_start(struct seq_file *m, loff_t *pos)
+{
+	struct kmem_demo_iter *it = m->private;
+	struct demo_struct *obj;
+	loff_t n;
+
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+
+	mutex_lock(&objects_mutex);
+	if (it->obj && it->pos == *pos && it->gen == demo_objects_gen)
+		return it->obj;
+
+	/* Cursor is stale (lseek, or the list changed): walk from the head */
+	n = 1;
+	list_for_each_entry(obj, &demo_objects, list) {
+		if (n++ == *pos) {
+			it->obj = obj;
+			it->pos = *pos;
+			it->gen = demo_objects_gen;
+			return obj;
+		}
+	}
+	return NULL;
+}
+
+static void *kmem_demo_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct kmem_demo_iter *it = m->private;
+	struct list_head *next;
+
+	if (v == SEQ_START_TOKEN) {
+		mutex_lock(&objects_mutex);
+		next = demo_objects.next;
+	} else {
+		next = ((struct demo_struct *)v)->list.next;
 	}
+	++*pos;
+	if (next == &demo_objects) {
+		it->obj = NULL;
+		return NULL;
+	}
+
+	it->obj = list_entry(next, struct demo_struct, list);
+	it->pos = *pos;
+	it->gen = demo_objects_gen;
+	return it->obj;
+}
+
+static void kmem_demo_seq_stop(struct seq_file *m, void *v)
+{
+	if (v != SEQ_START_TOKEN)
+		mutex_unlock(&objects_mutex);
+}
+
+static int kmem_demo_seq_show(struct seq_file *m, void *v)
+{
+	const struct demo_struct *obj = v;
 
+	if (v == SEQ_START_TOKEN) {
+		kmem_demo_show_summary(m);
+		return 0;
+	}
+	seq_printf(m, "   %10d %s\n", obj->id, obj->name);
 	return 0;
 }
 
+static const struct seq_operations kmem_demo_seq_ops = {
+	.start = kmem_demo_seq_start,
+	.next = kmem_demo_seq_next,
+	.stop = kmem_demo_seq_stop,
+	.show = kmem_demo_seq_show,
+};
+
 static int kmem_demo_open(struct inode *inode, struct file *file)
 {
-	return single_open(file, kmem_demo_show, NULL);
+	return seq_open_private(file, &kmem_demo_seq_ops,
+				sizeof(struct kmem_demo_iter));
 }
 
 static const struct proc_ops kmem_demo_fops = {
 	.proc_open = kmem_demo_open,
 	.proc_read = seq_read,
 	.proc_lseek = seq_lseek,
-	.proc_release = single_release,
+	.proc_release = seq_release_private,
+	.proc_write = kmem_demo_write,
 };
 
 /* Module initialization function */
@@ -183,33 +2480,64 @@ static int __init kmem_demo_init(void)
 	struct proc_dir_entry *proc_file;
 	int ret;
 
+	/* Allocate the shared stats page */
+	stats_page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!stats_page) {
+		pr_err("kmem_demo: Failed to allocate the stats page\n");
+		return -ENOMEM;
+	}
+	stats = page_address(stats_page);
+	stats->magic = KMEM_STATS_MAGIC;
+	stats->version = KMEM_STATS_VERSION;
+
 	/* Initialize memory allocations */
 	ret = init_memory();
 	if (ret)
-		return ret;
+		goto fail_memory;
+	kmem_stats_publish();
 
 	/* Create proc file */
-	proc_file = proc_create(PROCFS_NAME, 0444, NULL, &kmem_demo_fops);
+	proc_file = proc_create(PROCFS_NAME, 0644, NULL, &kmem_demo_fops);
 	if (!proc_file) {
 		pr_err("kmem_demo: Failed to create proc entry\n");
-		free_memory();
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto fail_proc;
+	}
+
+	/* Create the mmap-able stats page */
+	proc_file = proc_create(STATS_PROC_NAME, 0444, NULL, &kmem_stats_fops);
+	if (!proc_file) {
+		pr_err("kmem_demo: Failed to create stats proc entry\n");
+		ret = -ENOMEM;
+		goto fail_stats_proc;
 	}
 
 	pr_info("kmem_demo: Module loaded\n");
 	pr_info("kmem_demo: Created proc entry /proc/%s\n", PROCFS_NAME);
 	return 0;
+
+fail_stats_proc:
+	remove_proc_entry(PROCFS_NAME, NULL);
+fail_proc:
+	free_memory();
+fail_memory:
+	__free_page(stats_page);
+	return ret;
 }
 
 /* Module cleanup function */
 static void __exit kmem_demo_exit(void)
 {
-	/* Remove proc file */
+	/* Remove proc files */
+	remove_proc_entry(STATS_PROC_NAME, NULL);
 	remove_proc_entry(PROCFS_NAME, NULL);
 
 	/* Free all memory */
 	free_memory();
 
+	/* A monitor still mapping the page keeps it alive until munmap() */
+	__free_page(stats_page);
+
 	pr_info("kmem_demo: Module unloaded\n");
 }
 
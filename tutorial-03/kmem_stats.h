@@ -0,0 +1,33 @@
+/*
+ * Binary layout of /proc/kmem_demo_stats, shared by the module and
+ * test_kmem.c.
+ *
+ * The file is one read-only page that user space maps with mmap() and
+ * reads without any system call. The module bumps seq to an odd value
+ * before it updates the statistics and to the next even value after, so
+ * a reader copies them between two reads of seq and retries if seq was
+ * odd or changed.
+ */
+#ifndef _KMEM_STATS_H
+#define _KMEM_STATS_H
+
+#include <linux/types.h>
+
+#define KMEM_STATS_MAGIC 0x4b4d454d /* "KMEM" */
+#define KMEM_STATS_VERSION 1
+
+struct kmem_stats_page {
+	__u32 magic; /* KMEM_STATS_MAGIC */
+	__u32 version; /* KMEM_STATS_VERSION */
+	__u32 seq; /* Odd while an update is in progress */
+	__u32 reserved;
+	__u64 updates; /* Number of updates published */
+	__u64 kmalloc_bytes; /* Held by kmalloc */
+	__u64 vmalloc_bytes; /* Held by vmalloc */
+	__u64 page_bytes; /* Held by __get_free_pages */
+	__u64 cache_objects; /* Objects allocated from demo_cache */
+	__u64 cache_object_size; /* Size of one demo_cache object */
+	__u64 total_bytes; /* Sum of the above */
+};
+
+#endif /* _KMEM_STATS_H */
@@ -6,9 +6,15 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <time.h>
+
+#include "kmem_stats.h"
+#include "../include/stats_reader.h"
 
 #define PROC_PATH "/proc/kmem_demo"
+#define STATS_PATH "/proc/kmem_demo_stats"
 #define BUFFER_SIZE 2048
+#define CMD_SIZE 128 /* Longest command /proc/kmem_demo accepts */
 
 void display_usage(const char *program_name)
 {
@@ -18,6 +24,15 @@ void display_usage(const char *program_name)
 	printf("  load       - Load the module\n");
 	printf("  unload     - Unload the module\n");
 	printf("  monitor    - Monitor memory allocations over time\n");
+	printf("  stats [s]  - Read the shared stats page without system calls\n");
+	printf("  bench [n]  - Time n alloc/free pairs per allocator, size and GFP set\n");
+	printf("  scale [cpulist] [ms] - Allocator throughput vs. pinned thread count\n");
+	printf("  numa [MB] [ms] - Local vs. remote node latency and bandwidth\n");
+	printf("  tlb [ms]   - Access cost of base-page, huge and contiguous mappings\n");
+	printf("  frag [none|checker|random] [s] [pin_mb] - Mixed-order allocation stress\n");
+	printf("  objects <n> - Keep n demo_struct objects and time a full dump\n");
+	printf("  pressure [MB] - Shrink the object pool under memory pressure\n");
+	printf("  reserve [n] - Drain the pool and make n GFP_ATOMIC allocations with IRQs off\n");
 	printf("  help       - Display this help message\n");
 }
 
@@ -172,6 +187,383 @@ int monitor_memory()
 	return 0;
 }
 
+/* Write one command line to /proc/kmem_demo; it returns once it has run */
+int kmem_command(const char *cmd)
+{
+	int fd;
+
+	fd = open(PROC_PATH, O_WRONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", PROC_PATH,
+			strerror(errno));
+		return 1;
+	}
+	if (write(fd, cmd, strlen(cmd)) < 0) {
+		fprintf(stderr, "'%s' failed: %s\n", cmd, strerror(errno));
+		close(fd);
+		return 1;
+	}
+	close(fd);
+	return 0;
+}
+
+/* Print the section of /proc/kmem_demo whose heading contains @heading */
+int show_proc_section(const char *heading)
+{
+	char buffer[BUFFER_SIZE];
+	int printing = 0;
+	FILE *fp;
+
+	fp = fopen(PROC_PATH, "r");
+	if (!fp) {
+		fprintf(stderr, "Failed to open proc file %s: %s\n", PROC_PATH,
+			strerror(errno));
+		return 1;
+	}
+	while (fgets(buffer, BUFFER_SIZE, fp) != NULL) {
+		if (!printing && strstr(buffer, heading))
+			printing = 1;
+		else if (printing && buffer[0] == '\n')
+			break;
+		if (printing)
+			printf("%s", buffer);
+	}
+	fclose(fp);
+
+	if (!printing) {
+		fprintf(stderr, "No '%s' section in %s\n", heading, PROC_PATH);
+		return 1;
+	}
+	return 0;
+}
+
+/* Run the allocator sweep in the kernel and print its results */
+int run_bench(int iterations)
+{
+	char cmd[CMD_SIZE];
+
+	printf("Running the allocator benchmark (%d pairs per configuration)...\n",
+	       iterations);
+	snprintf(cmd, sizeof(cmd), "bench %d", iterations);
+	if (kmem_command(cmd))
+		return 1;
+	return show_proc_section("Allocator benchmark");
+}
+
+/* Run the scalability benchmark on @cpus and print its results */
+int run_scale(const char *cpus, int ms)
+{
+	char cmd[CMD_SIZE];
+
+	printf("Running the scalability benchmark on CPUs %s (%d ms per point)...\n",
+	       cpus, ms);
+	snprintf(cmd, sizeof(cmd), "scale %s %d", cpus, ms);
+	if (kmem_command(cmd))
+		return 1;
+	return show_proc_section("Allocator scalability");
+}
+
+/* Run the NUMA access benchmark over @mb MB per node and print its results */
+int run_numa(int mb, int ms)
+{
+	char cmd[CMD_SIZE];
+
+	printf("Running the NUMA access benchmark (%d MB per node, %d ms per measurement)...\n",
+	       mb, ms);
+	snprintf(cmd, sizeof(cmd), "numa %d %d", mb, ms);
+	if (kmem_command(cmd))
+		return 1;
+	return show_proc_section("NUMA access");
+}
+
+/* Run the vmalloc mapping benchmark and print its results */
+int run_tlb(int ms)
+{
+	char cmd[CMD_SIZE];
+
+	printf("Running the vmalloc mapping benchmark (%d ms per measurement)...\n",
+	       ms);
+	snprintf(cmd, sizeof(cmd), "tlb %d", ms);
+	if (kmem_command(cmd))
+		return 1;
+	return show_proc_section("vmalloc mapping cost");
+}
+
+/* Run the fragmentation stress and print its results */
+int run_frag(const char *pattern, int seconds, int pin_mb)
+{
+	char cmd[CMD_SIZE];
+
+	printf("Running the fragmentation stress (%s pattern, %d MB pinned, %d s)...\n",
+	       pattern, pin_mb, seconds);
+	snprintf(cmd, sizeof(cmd), "frag %s %d %d", pattern, seconds, pin_mb);
+	if (kmem_command(cmd))
+		return 1;
+	return show_proc_section("Fragmentation stress");
+}
+
+/*
+ * Resize the object inventory to @count and read all of /proc/kmem_demo
+ * in page-sized read() calls, reporting how long the dump took
+ */
+int run_objects(long count)
+{
+	char cmd[CMD_SIZE], buffer[4096];
+	unsigned long long bytes = 0, lines = 0, reads = 0;
+	struct timespec start, end;
+	double seconds;
+	ssize_t len;
+	int fd;
+
+	printf("Resizing the inventory to %ld objects...\n", count);
+	snprintf(cmd, sizeof(cmd), "objects %ld", count);
+	if (kmem_command(cmd))
+		return 1;
+
+	fd = open(PROC_PATH, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", PROC_PATH,
+			strerror(errno));
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+		bytes += len;
+		reads++;
+		for (ssize_t i = 0; i < len; i++)
+			lines += buffer[i] == '\n';
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	close(fd);
+	if (len < 0) {
+		fprintf(stderr, "Failed to read %s: %s\n", PROC_PATH,
+			strerror(errno));
+		return 1;
+	}
+
+	seconds = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("Read %llu lines, %llu bytes in %llu read() calls in %.3f s (%.1f MB/s)\n",
+	       lines, bytes, reads, seconds,
+	       seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+	return 0;
+}
+
+/* Read the pool's cached object count and shrinker total from the proc file */
+int pool_counters(long *cached, long *freed)
+{
+	char buffer[BUFFER_SIZE];
+	long depot = -1, percpu = -1;
+	FILE *fp;
+	char *p;
+
+	*freed = -1;
+	fp = fopen(PROC_PATH, "r");
+	if (!fp) {
+		fprintf(stderr, "Failed to open proc file %s: %s\n", PROC_PATH,
+			strerror(errno));
+		return 1;
+	}
+	while (fgets(buffer, BUFFER_SIZE, fp) != NULL) {
+		p = strstr(buffer, "magazines with ");
+		if (p)
+			sscanf(p, "magazines with %ld objects in depot, %ld",
+			       &depot, &percpu);
+		p = strstr(buffer, "shrinker freed ");
+		if (p)
+			sscanf(p, "shrinker freed %ld", freed);
+		if (strstr(buffer, "demo_struct inventory"))
+			break;
+	}
+	fclose(fp);
+
+	if (depot < 0 || percpu < 0 || *freed < 0) {
+		fprintf(stderr, "No pool statistics in %s\n", PROC_PATH);
+		return 1;
+	}
+	*cached = depot + percpu;
+	return 0;
+}
+
+/* Time "objects @count", i.e. @count pool allocations, in nanoseconds */
+long long time_objects(long count)
+{
+	struct timespec start, end;
+	char cmd[CMD_SIZE];
+
+	snprintf(cmd, sizeof(cmd), "objects %ld", count);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (kmem_command(cmd))
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) * 1000000000LL +
+	       (end.tv_nsec - start.tv_nsec);
+}
+
+/*
+ * Put the object pool under memory pressure and report what its shrinker
+ * gave back. With @mb zero, pressure comes from writing 2 to
+ * /proc/sys/vm/drop_caches, which runs every shrinker once. Otherwise
+ * @mb MB of anonymous memory are touched, which only reclaims if the
+ * machine has less free memory than that.
+ */
+int run_pressure(long mb)
+{
+	long cached, freed, cached_after, freed_after;
+	long long warm_ns, cold_ns;
+	FILE *fp;
+
+	/* Fill the pool's magazines by creating and freeing objects */
+	if (kmem_command("objects 100000") || kmem_command("objects 0"))
+		return 1;
+	if (pool_counters(&cached, &freed))
+		return 1;
+	if (cached == 0) {
+		fprintf(stderr, "The pool cached no objects\n");
+		return 1;
+	}
+
+	/* Allocation cost with a warm pool, then warm it again */
+	warm_ns = time_objects(cached);
+	if (warm_ns < 0 || kmem_command("objects 0"))
+		return 1;
+
+	if (mb == 0) {
+		printf("Dropping slab caches...\n");
+		fp = fopen("/proc/sys/vm/drop_caches", "w");
+		if (!fp || fputs("2", fp) == EOF || fclose(fp) == EOF) {
+			fprintf(stderr, "Failed to write drop_caches: %s\n",
+				strerror(errno));
+			return 1;
+		}
+	} else {
+		char *mem;
+
+		printf("Touching %ld MB of memory...\n", mb);
+		mem = malloc(mb << 20);
+		if (!mem) {
+			fprintf(stderr, "Failed to allocate %ld MB\n", mb);
+			return 1;
+		}
+		for (long off = 0; off < mb << 20; off += 4096)
+			mem[off] = 1;
+		free(mem);
+	}
+
+	if (pool_counters(&cached_after, &freed_after))
+		return 1;
+
+	/* Allocation cost once the shrinker has emptied the pool */
+	cold_ns = time_objects(cached);
+	if (cold_ns < 0 || kmem_command("objects 0"))
+		return 1;
+
+	printf("Cached objects: %ld before, %ld after pressure\n", cached,
+	       cached_after);
+	printf("Reclaimed by the shrinker: %ld objects\n", freed_after - freed);
+	printf("Allocating %ld objects: %.1f ns each warm, %.1f ns each after reclaim\n",
+	       cached, (double)warm_ns / cached, (double)cold_ns / cached);
+	return 0;
+}
+
+/* Write @val to the debugfs or sysfs file @path */
+int write_knob(const char *path, const char *val)
+{
+	FILE *fp;
+
+	fp = fopen(path, "w");
+	if (!fp || fputs(val, fp) == EOF || fclose(fp) == EOF) {
+		fprintf(stderr, "Failed to write %s: %s\n", path,
+			strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+#define FAILSLAB_DIR "/sys/kernel/debug/failslab"
+#define CACHE_FAILSLAB "/sys/kernel/slab/demo_cache/failslab"
+
+/*
+ * Drain the object pool and make @n GFP_ATOMIC allocations from it with
+ * interrupts disabled, first with a healthy slab and then, if the kernel
+ * has failslab, with every demo_cache allocation failing so the mempool
+ * reserve has to serve them.
+ */
+int run_reserve(int n)
+{
+	char cmd[CMD_SIZE];
+	int ret;
+
+	snprintf(cmd, sizeof(cmd), "reserve %d", n);
+	printf("Slab healthy:\n");
+	if (kmem_command(cmd) || show_proc_section("reserve test:"))
+		return 1;
+
+	if (access(FAILSLAB_DIR, F_OK) || access(CACHE_FAILSLAB, F_OK)) {
+		printf("No failslab (CONFIG_FAILSLAB and debugfs), skipping the failing slab run\n");
+		return 0;
+	}
+
+	/*
+	 * Only demo_cache fails. A cache merged with another one refuses
+	 * the failslab flag; boot with slab_nomerge in that case.
+	 */
+	if (write_knob(FAILSLAB_DIR "/cache-filter", "Y") ||
+	    write_knob(FAILSLAB_DIR "/probability", "100") ||
+	    write_knob(FAILSLAB_DIR "/interval", "1") ||
+	    write_knob(FAILSLAB_DIR "/times", "-1") ||
+	    write_knob(CACHE_FAILSLAB, "1"))
+		ret = 1;
+	else {
+		printf("\nSlab failing (failslab on demo_cache):\n");
+		ret = kmem_command(cmd) || show_proc_section("reserve test:");
+	}
+
+	/* Restore, even after a partial setup */
+	write_knob(CACHE_FAILSLAB, "0");
+	write_knob(FAILSLAB_DIR "/probability", "0");
+	return ret;
+}
+
+STATS_PAGE_CHECK_LAYOUT(struct kmem_stats_page);
+
+/*
+ * Poll the stats page as fast as possible for @seconds, printing the
+ * statistics and the snapshot rate once per second.
+ */
+int stats_monitor(int seconds)
+{
+	const struct kmem_stats_page *page;
+	struct kmem_stats_page snap;
+
+	page = stats_page_map(STATS_PATH, KMEM_STATS_MAGIC, KMEM_STATS_VERSION);
+	if (!page)
+		return 1;
+
+	printf("%8s %10s %10s %10s %8s %10s %12s %8s\n", "updates",
+	       "kmalloc", "vmalloc", "pages", "objects", "total", "reads/s",
+	       "retries");
+	for (int i = 0; i < seconds; i++) {
+		unsigned long long reads = 0, retries = 0;
+		time_t end = time(NULL) + 1;
+
+		while (time(NULL) < end) {
+			retries += stats_page_snapshot(page, &snap);
+			reads++;
+		}
+		printf("%8llu %10llu %10llu %10llu %8llu %10llu %12llu %8llu\n",
+		       (unsigned long long)snap.updates,
+		       (unsigned long long)snap.kmalloc_bytes,
+		       (unsigned long long)snap.vmalloc_bytes,
+		       (unsigned long long)snap.page_bytes,
+		       (unsigned long long)snap.cache_objects,
+		       (unsigned long long)snap.total_bytes, reads, retries);
+	}
+
+	stats_page_unmap(page);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc < 2) {
@@ -187,6 +579,97 @@ int main(int argc, char *argv[])
 		return unload_module();
 	} else if (strcmp(argv[1], "monitor") == 0) {
 		return monitor_memory();
+	} else if (strcmp(argv[1], "stats") == 0) {
+		int seconds = 5;
+
+		if (argc >= 3) {
+			seconds = atoi(argv[2]);
+		}
+
+		return stats_monitor(seconds);
+	} else if (strcmp(argv[1], "bench") == 0) {
+		int iterations = 1000;
+
+		if (argc >= 3) {
+			iterations = atoi(argv[2]);
+		}
+
+		return run_bench(iterations);
+	} else if (strcmp(argv[1], "scale") == 0) {
+		const char *cpus = "all";
+		int ms = 200;
+
+		if (argc >= 3) {
+			cpus = argv[2];
+		}
+
+		if (argc >= 4) {
+			ms = atoi(argv[3]);
+		}
+
+		return run_scale(cpus, ms);
+	} else if (strcmp(argv[1], "numa") == 0) {
+		int mb = 64;
+		int ms = 200;
+
+		if (argc >= 3) {
+			mb = atoi(argv[2]);
+		}
+
+		if (argc >= 4) {
+			ms = atoi(argv[3]);
+		}
+
+		return run_numa(mb, ms);
+	} else if (strcmp(argv[1], "tlb") == 0) {
+		int ms = 200;
+
+		if (argc >= 3) {
+			ms = atoi(argv[2]);
+		}
+
+		return run_tlb(ms);
+	} else if (strcmp(argv[1], "frag") == 0) {
+		const char *pattern = "checker";
+		int seconds = 10;
+		int pin_mb = 256;
+
+		if (argc >= 3) {
+			pattern = argv[2];
+		}
+
+		if (argc >= 4) {
+			seconds = atoi(argv[3]);
+		}
+
+		if (argc >= 5) {
+			pin_mb = atoi(argv[4]);
+		}
+
+		return run_frag(pattern, seconds, pin_mb);
+	} else if (strcmp(argv[1], "objects") == 0) {
+		if (argc < 3) {
+			fprintf(stderr, "Error: objects needs a count\n");
+			return 1;
+		}
+
+		return run_objects(atol(argv[2]));
+	} else if (strcmp(argv[1], "pressure") == 0) {
+		long mb = 0;
+
+		if (argc >= 3) {
+			mb = atol(argv[2]);
+		}
+
+		return run_pressure(mb);
+	} else if (strcmp(argv[1], "reserve") == 0) {
+		int n = 128;
+
+		if (argc >= 3) {
+			n = atoi(argv[2]);
+		}
+
+		return run_reserve(n);
 	} else if (strcmp(argv[1], "help") == 0) {
 		display_usage(argv[0]);
 		return 0;
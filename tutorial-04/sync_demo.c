@@ -15,12 +15,17 @@
 #include <linux/delay.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <linux/mm.h> /* For vm_insert_page */
+#include <linux/timekeeping.h> /* For ktime_get_ns */
 #include <linux/version.h> /* For LINUX_VERSION_CODE */
 
+#include "sync_stats.h"
+
 #define DEVICE_NAME "sync_demo"
 #define CLASS_NAME "sync"
 #define BUFFER_SIZE 1024
 #define NUM_COUNTERS 4
+#define STATS_PROC_NAME "sync_demo_stats"
 
 /* Module metadata */
 MODULE_LICENSE("GPL");
@@ -45,6 +50,11 @@ static struct device *sync_device = NULL;
 static struct cdev sync_cdev;
 static char device_buffer[BUFFER_SIZE];
 
+/* Shared stats page, mapped read-only through /proc/sync_demo_stats */
+static struct page *stats_page;
+static struct sync_stats_page *stats;
+static DEFINE_SPINLOCK(stats_publish_lock); /* Serializes publishers */
+
 /* Thread-related variables */
 static struct task_struct *demo_thread = NULL;
 static bool thread_should_stop = false;
@@ -121,6 +131,60 @@ static const struct proc_ops sync_proc_fops = {
 	.proc_release = single_release,
 };
 
+/*
+ * Publish the five counters, once per iteration of the demo thread and
+ * after a reset. Each counter is read without the lock that protects it:
+ * it is a single aligned word, and the page only promises that the five
+ * values were copied together, not that they were taken at one instant.
+ * This is the same seqcount pattern the module demonstrates, with the
+ * reader in user space; stats_publish_lock plays the writer lock.
+ */
+static void sync_stats_publish(void)
+{
+	spin_lock(&stats_publish_lock);
+	WRITE_ONCE(stats->seq, stats->seq + 1);
+	smp_wmb();
+
+	WRITE_ONCE(stats->atomic_counter, atomic_read(&atomic_counter));
+	WRITE_ONCE(stats->spin_counter, READ_ONCE(counter_values[1]));
+	WRITE_ONCE(stats->mutex_counter, READ_ONCE(counter_values[2]));
+	WRITE_ONCE(stats->sem_counter, READ_ONCE(counter_values[3]));
+	WRITE_ONCE(stats->rwsem_counter, READ_ONCE(counter_values[0]));
+	WRITE_ONCE(stats->updates, stats->updates + 1);
+	WRITE_ONCE(stats->update_ns, ktime_get_ns());
+
+	smp_wmb();
+	WRITE_ONCE(stats->seq, stats->seq + 1);
+	spin_unlock(&stats_publish_lock);
+}
+
+/*
+ * mmap() of /proc/sync_demo_stats. Only a single read-only page at
+ * offset 0 is accepted, so test_sync can watch the counters change
+ * without a read() per sample.
+ */
+static int sync_stats_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	/* User space must never be able to write the counters */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+	/* Each mapping pins the page, so rmmod may run while it is mapped */
+	return vm_insert_page(vma, vma->vm_start, stats_page);
+}
+
+static const struct proc_ops sync_stats_fops = {
+	.proc_mmap = sync_stats_mmap,
+};
+
 /* Thread function to demonstrate concurrency */
 static int demo_thread_fn(void *data)
 {
@@ -155,6 +219,8 @@ static int demo_thread_fn(void *data)
 			atomic_read(&atomic_counter); /* Sync with atomic */
 		up_write(&rwsem_counter_lock);
 
+		sync_stats_publish();
+
 		/* Sleep to demonstrate that other code can run */
 		msleep(1000); /* Sleep for 1 second */
 	}
@@ -242,6 +308,7 @@ static ssize_t sync_demo_write(struct file *file,
 		counter_values[0] = 0;
 		up_write(&rwsem_counter_lock);
 
+		sync_stats_publish();
 		pr_info("sync_demo: All counters reset\n");
 	}
 
@@ -262,10 +329,21 @@ static int __init sync_demo_init(void)
 	sema_init(&sem_counter_lock, 1); /* Binary semaphore */
 	init_rwsem(&rwsem_counter_lock);
 
+	/* Allocate the shared stats page */
+	stats_page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!stats_page) {
+		pr_err("sync_demo: Failed to allocate the stats page\n");
+		return -ENOMEM;
+	}
+	stats = page_address(stats_page);
+	stats->magic = SYNC_STATS_MAGIC;
+	stats->version = SYNC_STATS_VERSION;
+
 	/* Dynamically allocate a major number */
 	major_number = register_chrdev(0, DEVICE_NAME, &sync_fops);
 	if (major_number < 0) {
 		pr_err("sync_demo: Failed to register a major number\n");
+		__free_page(stats_page);
 		return major_number;
 	}
 	pr_info("sync_demo: Registered with major number %d\n", major_number);
@@ -280,6 +358,7 @@ static int __init sync_demo_init(void)
 #endif
 	if (IS_ERR(sync_class)) {
 		unregister_chrdev(major_number, DEVICE_NAME);
+		__free_page(stats_page);
 		pr_err("sync_demo: Failed to register device class\n");
 		return PTR_ERR(sync_class);
 	}
@@ -291,6 +370,7 @@ static int __init sync_demo_init(void)
 	if (IS_ERR(sync_device)) {
 		class_destroy(sync_class);
 		unregister_chrdev(major_number, DEVICE_NAME);
+		__free_page(stats_page);
 		pr_err("sync_demo: Failed to create the device\n");
 		return PTR_ERR(sync_device);
 	}
@@ -306,6 +386,7 @@ static int __init sync_demo_init(void)
 		device_destroy(sync_class, MKDEV(major_number, 0));
 		class_destroy(sync_class);
 		unregister_chrdev(major_number, DEVICE_NAME);
+		__free_page(stats_page);
 		pr_err("sync_demo: Failed to add character device\n");
 		return -EFAULT;
 	}
@@ -317,18 +398,35 @@ static int __init sync_demo_init(void)
 		device_destroy(sync_class, MKDEV(major_number, 0));
 		class_destroy(sync_class);
 		unregister_chrdev(major_number, DEVICE_NAME);
+		__free_page(stats_page);
 		pr_err("sync_demo: Failed to create proc entry\n");
 		return -ENOMEM;
 	}
 
+	/* Create the mmap-able stats page */
+	proc_file = proc_create(STATS_PROC_NAME, 0444, NULL, &sync_stats_fops);
+	if (!proc_file) {
+		remove_proc_entry("sync_demo", NULL);
+		cdev_del(&sync_cdev);
+		device_destroy(sync_class, MKDEV(major_number, 0));
+		class_destroy(sync_class);
+		unregister_chrdev(major_number, DEVICE_NAME);
+		__free_page(stats_page);
+		pr_err("sync_demo: Failed to create stats proc entry\n");
+		return -ENOMEM;
+	}
+	sync_stats_publish();
+
 	/* Start the demo thread */
 	demo_thread = kthread_run(demo_thread_fn, NULL, "sync_demo_thread");
 	if (IS_ERR(demo_thread)) {
+		remove_proc_entry(STATS_PROC_NAME, NULL);
 		remove_proc_entry("sync_demo", NULL);
 		cdev_del(&sync_cdev);
 		device_destroy(sync_class, MKDEV(major_number, 0));
 		class_destroy(sync_class);
 		unregister_chrdev(major_number, DEVICE_NAME);
+		__free_page(stats_page);
 		pr_err("sync_demo: Failed to create kernel thread\n");
 		return PTR_ERR(demo_thread);
 	}
@@ -344,7 +442,8 @@ static void __exit sync_demo_exit(void)
 	if (demo_thread)
 		kthread_stop(demo_thread);
 
-	/* Remove the proc file */
+	/* Remove the proc files */
+	remove_proc_entry(STATS_PROC_NAME, NULL);
 	remove_proc_entry("sync_demo", NULL);
 
 	/* Remove the character device */
@@ -359,6 +458,9 @@ static void __exit sync_demo_exit(void)
 	/* Unregister the major number */
 	unregister_chrdev(major_number, DEVICE_NAME);
 
+	/* Drop our reference; the page is freed with its last mapping */
+	__free_page(stats_page);
+
 	pr_info("sync_demo: Module unloaded\n");
 }
 
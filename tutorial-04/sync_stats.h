@@ -0,0 +1,33 @@
+/*
+ * Binary layout of /proc/sync_demo_stats, shared by the module and
+ * test_sync.c.
+ *
+ * The file is one read-only page that user space maps with mmap() and
+ * reads without any system call. The module bumps seq to an odd value
+ * before it updates the counters and to the next even value after, so a
+ * reader copies the counters between two reads of seq and retries if seq
+ * was odd or changed.
+ */
+#ifndef _SYNC_STATS_H
+#define _SYNC_STATS_H
+
+#include <linux/types.h>
+
+#define SYNC_STATS_MAGIC 0x53594e43 /* "SYNC" */
+#define SYNC_STATS_VERSION 1
+
+struct sync_stats_page {
+	__u32 magic; /* SYNC_STATS_MAGIC */
+	__u32 version; /* SYNC_STATS_VERSION */
+	__u32 seq; /* Odd while an update is in progress */
+	__u32 reserved;
+	__u64 updates; /* Number of updates published */
+	__u64 update_ns; /* CLOCK_MONOTONIC time of the last update */
+	__s64 atomic_counter;
+	__s64 spin_counter;
+	__s64 mutex_counter;
+	__s64 sem_counter;
+	__s64 rwsem_counter;
+};
+
+#endif /* _SYNC_STATS_H */
@@ -6,9 +6,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <time.h>
+
+#include "sync_stats.h"
+#include "../include/stats_reader.h"
 
 #define DEVICE_PATH "/dev/sync_demo"
 #define PROC_PATH "/proc/sync_demo"
+#define STATS_PATH "/proc/sync_demo_stats"
 #define BUFFER_SIZE 1024
 
 void display_device_info()
@@ -93,8 +98,57 @@ void reset_counters()
 	close(fd);
 }
 
-int main()
+STATS_PAGE_CHECK_LAYOUT(struct sync_stats_page);
+
+/*
+ * Poll the stats page as fast as possible for @seconds, printing the
+ * counters and the snapshot rate once per second.
+ */
+int stats_monitor(int seconds)
+{
+	const struct sync_stats_page *page;
+	struct sync_stats_page snap;
+
+	page = stats_page_map(STATS_PATH, SYNC_STATS_MAGIC, SYNC_STATS_VERSION);
+	if (!page)
+		return 1;
+
+	printf("%8s %8s %8s %8s %8s %8s %12s %8s\n", "updates", "atomic",
+	       "spin", "mutex", "sem", "rwsem", "reads/s", "retries");
+	for (int i = 0; i < seconds; i++) {
+		unsigned long long reads = 0, retries = 0;
+		time_t end = time(NULL) + 1;
+
+		while (time(NULL) < end) {
+			retries += stats_page_snapshot(page, &snap);
+			reads++;
+		}
+		printf("%8llu %8lld %8lld %8lld %8lld %8lld %12llu %8llu\n",
+		       (unsigned long long)snap.updates,
+		       (long long)snap.atomic_counter,
+		       (long long)snap.spin_counter,
+		       (long long)snap.mutex_counter,
+		       (long long)snap.sem_counter,
+		       (long long)snap.rwsem_counter, reads, retries);
+	}
+
+	stats_page_unmap(page);
+	return 0;
+}
+
+int main(int argc, char *argv[])
 {
+	/* Non-interactive: read the shared stats page */
+	if (argc >= 2 && strcmp(argv[1], "stats") == 0) {
+		int seconds = 5;
+
+		if (argc >= 3) {
+			seconds = atoi(argv[2]);
+		}
+
+		return stats_monitor(seconds);
+	}
+
 	printf("Sync Demo Test Program\n");
 	printf("======================\n");
 
@@ -16,11 +16,15 @@
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 #include <linux/kthread.h>
+#include <linux/mm.h> /* For vm_insert_page */
 #include <linux/version.h> /* For LINUX_VERSION_CODE */
 
+#include "irq_stats.h"
+
 #define DEVICE_NAME "irq_demo"
 #define CLASS_NAME "irq"
 #define BUFFER_SIZE 1024
+#define STATS_PROC_NAME "irq_demo_stats"
 
 /* Module metadata */
 MODULE_LICENSE("GPL");
@@ -51,6 +55,10 @@ static ktime_t last_bh_time;
 static spinlock_t stats_lock;
 static struct mutex proc_mutex;
 
+/* Shared stats page, mapped read-only through /proc/irq_demo_stats */
+static struct page *stats_page;
+static struct irq_stats_page *stats;
+
 /* Device variables */
 static int major_number;
 static struct class *irq_class = NULL;
@@ -150,6 +158,57 @@ static const struct proc_ops irq_proc_fops = {
 	.proc_release = single_release,
 };
 
+/*
+ * Publish the interrupt statistics. This runs in the top half too, so it
+ * must not sleep or take another lock: callers hold stats_lock with
+ * interrupts disabled, which already serializes every publisher and keeps
+ * an interrupt from landing between the two seq updates on this CPU. A
+ * user-space reader never blocks the handler; it simply retries.
+ */
+static void irq_stats_publish(void)
+{
+	WRITE_ONCE(stats->seq, stats->seq + 1);
+	smp_wmb();
+
+	WRITE_ONCE(stats->irq_count, atomic_read(&irq_count));
+	WRITE_ONCE(stats->bottom_half_count, atomic_read(&bottom_half_count));
+	WRITE_ONCE(stats->delayed_work_count,
+		   atomic_read(&delayed_work_count));
+	WRITE_ONCE(stats->last_irq_ns, ktime_to_ns(last_irq_time));
+	WRITE_ONCE(stats->last_bh_ns, ktime_to_ns(last_bh_time));
+	WRITE_ONCE(stats->updates, stats->updates + 1);
+
+	smp_wmb();
+	WRITE_ONCE(stats->seq, stats->seq + 1);
+}
+
+/*
+ * mmap() of /proc/irq_demo_stats: one read-only page at offset 0. Lets
+ * test_irq sample interrupt counts and latencies without entering the
+ * kernel, so polling does not perturb what it measures.
+ */
+static int irq_stats_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	/* The handler writes this page; user space may only look */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+	/* The page stays valid for this mapping even after rmmod */
+	return vm_insert_page(vma, vma->vm_start, stats_page);
+}
+
+static const struct proc_ops irq_stats_fops = {
+	.proc_mmap = irq_stats_mmap,
+};
+
 /* Regular workqueue function (bottom half) */
 static void demo_work_handler(struct work_struct *work)
 {
@@ -164,6 +223,7 @@ static void demo_work_handler(struct work_struct *work)
 	/* Use spinlock to protect shared data (timestamps) */
 	spin_lock_irqsave(&stats_lock, flags);
 	last_bh_time = now;
+	irq_stats_publish();
 	spin_unlock_irqrestore(&stats_lock, flags);
 
 	pr_info("irq_demo: Bottom half (work) executed, count: %d\n",
@@ -173,9 +233,15 @@ static void demo_work_handler(struct work_struct *work)
 /* Delayed workqueue function */
 static void demo_delayed_work_handler(struct work_struct *work)
 {
+	unsigned long flags;
+
 	/* Update counter */
 	atomic_inc(&delayed_work_count);
 
+	spin_lock_irqsave(&stats_lock, flags);
+	irq_stats_publish();
+	spin_unlock_irqrestore(&stats_lock, flags);
+
 	pr_info("irq_demo: Delayed work executed, count: %d\n",
 		atomic_read(&delayed_work_count));
 
@@ -198,6 +264,7 @@ static irqreturn_t button_irq_handler(int irq, void *dev_id)
 	/* Use spinlock to protect shared data (timestamp) */
 	spin_lock_irqsave(&stats_lock, flags);
 	last_irq_time = now;
+	irq_stats_publish();
 	spin_unlock_irqrestore(&stats_lock, flags);
 
 	/* Schedule the bottom half */
@@ -270,6 +337,7 @@ static ssize_t irq_demo_write(struct file *file, const char __user *user_buffer,
 {
 	char buffer[16];
 	size_t bytes_to_copy = min(count, sizeof(buffer) - 1);
+	unsigned long flags;
 
 	/* Copy from user */
 	if (copy_from_user(buffer, user_buffer, bytes_to_copy))
@@ -288,6 +356,10 @@ static ssize_t irq_demo_write(struct file *file, const char __user *user_buffer,
 		atomic_set(&irq_count, 0);
 		atomic_set(&bottom_half_count, 0);
 		atomic_set(&delayed_work_count, 0);
+
+		spin_lock_irqsave(&stats_lock, flags);
+		irq_stats_publish();
+		spin_unlock_irqrestore(&stats_lock, flags);
 		pr_info("irq_demo: All counters reset\n");
 	}
 
@@ -303,6 +375,16 @@ static int __init irq_demo_init(void)
 	spin_lock_init(&stats_lock);
 	mutex_init(&proc_mutex);
 
+	/* Allocate the shared stats page before anything can publish */
+	stats_page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!stats_page) {
+		pr_err("irq_demo: Failed to allocate the stats page\n");
+		return -ENOMEM;
+	}
+	stats = page_address(stats_page);
+	stats->magic = IRQ_STATS_MAGIC;
+	stats->version = IRQ_STATS_VERSION;
+
 	/* Initialize work items */
 	INIT_WORK(&regular_work, demo_work_handler);
 	INIT_DELAYED_WORK(&delayed_work, demo_delayed_work_handler);
@@ -311,6 +393,7 @@ static int __init irq_demo_init(void)
 	demo_wq = create_workqueue("irq_demo_wq");
 	if (!demo_wq) {
 		pr_err("irq_demo: Failed to create workqueue\n");
+		__free_page(stats_page);
 		return -ENOMEM;
 	}
 
@@ -420,10 +503,20 @@ static int __init irq_demo_init(void)
 		goto fail_proc_create;
 	}
 
+	/* Create the mmap-able stats page */
+	proc_file = proc_create(STATS_PROC_NAME, 0444, NULL, &irq_stats_fops);
+	if (!proc_file) {
+		pr_err("irq_demo: Failed to create stats proc entry\n");
+		ret = -ENOMEM;
+		goto fail_stats_proc_create;
+	}
+
 	pr_info("irq_demo: Module loaded\n");
 	return 0;
 
 /* Error handling and cleanup */
+fail_stats_proc_create:
+	remove_proc_entry("irq_demo", NULL);
 fail_proc_create:
 	cdev_del(&irq_cdev);
 fail_cdev_add:
@@ -446,6 +539,7 @@ fail_gpio:
 	cancel_delayed_work_sync(&delayed_work);
 	flush_workqueue(demo_wq);
 	destroy_workqueue(demo_wq);
+	__free_page(stats_page);
 
 	return ret;
 }
@@ -467,7 +561,8 @@ static void __exit irq_demo_exit(void)
 		gpio_free(BUTTON_GPIO);
 	}
 
-	/* Remove proc file */
+	/* Remove proc files */
+	remove_proc_entry(STATS_PROC_NAME, NULL);
 	remove_proc_entry("irq_demo", NULL);
 
 	/* Remove the character device */
@@ -482,6 +577,9 @@ static void __exit irq_demo_exit(void)
 	/* Unregister the major number */
 	unregister_chrdev(major_number, DEVICE_NAME);
 
+	/* Nothing publishes any more; mappings hold their own reference */
+	__free_page(stats_page);
+
 	pr_info("irq_demo: Module unloaded\n");
 }
 
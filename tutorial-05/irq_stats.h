@@ -0,0 +1,32 @@
+/*
+ * Binary layout of /proc/irq_demo_stats, shared by the module and
+ * test_irq.c.
+ *
+ * The file is one read-only page that user space maps with mmap() and
+ * reads without any system call. The module bumps seq to an odd value
+ * before it updates the statistics and to the next even value after, so
+ * a reader copies them between two reads of seq and retries if seq was
+ * odd or changed.
+ */
+#ifndef _IRQ_STATS_H
+#define _IRQ_STATS_H
+
+#include <linux/types.h>
+
+#define IRQ_STATS_MAGIC 0x49525153 /* "IRQS" */
+#define IRQ_STATS_VERSION 1
+
+struct irq_stats_page {
+	__u32 magic; /* IRQ_STATS_MAGIC */
+	__u32 version; /* IRQ_STATS_VERSION */
+	__u32 seq; /* Odd while an update is in progress */
+	__u32 reserved;
+	__u64 updates; /* Number of updates published */
+	__u64 irq_count; /* Top halves run */
+	__u64 bottom_half_count; /* Work items run */
+	__u64 delayed_work_count; /* Delayed work items run */
+	__s64 last_irq_ns; /* CLOCK_MONOTONIC time of the last top half */
+	__s64 last_bh_ns; /* CLOCK_MONOTONIC time of the last bottom half */
+};
+
+#endif /* _IRQ_STATS_H */
@@ -6,9 +6,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <time.h>
+
+#include "irq_stats.h"
+#include "../include/stats_reader.h"
 
 #define DEVICE_PATH "/dev/irq_demo"
 #define PROC_PATH "/proc/irq_demo"
+#define STATS_PATH "/proc/irq_demo_stats"
 #define BUFFER_SIZE 1024
 
 void display_device_info()
@@ -141,8 +146,57 @@ void run_latency_test(int iterations)
 	}
 }
 
+STATS_PAGE_CHECK_LAYOUT(struct irq_stats_page);
+
+/*
+ * Poll the stats page as fast as possible for @seconds, printing the
+ * statistics and the snapshot rate once per second.
+ */
+int stats_monitor(int seconds)
+{
+	const struct irq_stats_page *page;
+	struct irq_stats_page snap;
+
+	page = stats_page_map(STATS_PATH, IRQ_STATS_MAGIC, IRQ_STATS_VERSION);
+	if (!page)
+		return 1;
+
+	printf("%8s %8s %8s %8s %14s %12s %8s\n", "updates", "irqs", "bh",
+	       "delayed", "bh latency ns", "reads/s", "retries");
+	for (int i = 0; i < seconds; i++) {
+		unsigned long long reads = 0, retries = 0;
+		time_t end = time(NULL) + 1;
+
+		while (time(NULL) < end) {
+			retries += stats_page_snapshot(page, &snap);
+			reads++;
+		}
+		printf("%8llu %8llu %8llu %8llu %14lld %12llu %8llu\n",
+		       (unsigned long long)snap.updates,
+		       (unsigned long long)snap.irq_count,
+		       (unsigned long long)snap.bottom_half_count,
+		       (unsigned long long)snap.delayed_work_count,
+		       (long long)(snap.last_bh_ns - snap.last_irq_ns), reads,
+		       retries);
+	}
+
+	stats_page_unmap(page);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
+	/* Non-interactive: read the shared stats page */
+	if (argc >= 2 && strcmp(argv[1], "stats") == 0) {
+		int seconds = 5;
+
+		if (argc >= 3) {
+			seconds = atoi(argv[2]);
+		}
+
+		return stats_monitor(seconds);
+	}
+
 	printf("IRQ Demo Test Program\n");
 	printf("====================\n");
 